@@ -0,0 +1,426 @@
+/*
+ * Copyright 2019, Chee Bin Hoh, All right reserved.
+ *
+ * This program benchmarks builds of trafficdemand.c with a standard mix of queries over a dataset,
+ * for example one written by gendemand.c. Each query is run a few times by each program, and the
+ * run with the median wall time is reported with rows per second, the time to the first byte
+ * of output (reading the dataset) and after it (printing), CPU time and peak RSS.
+ *
+ */
+
+
+/* wait4 gives the peak RSS of each run, it is BSD rather than POSIX.1-2008 */
+
+#define _DEFAULT_SOURCE
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+
+enum
+{
+    GEOHASH6_LEN      = 6,
+    NUM_GEOHASH6      = 3,
+    NUM_SCANNED_LINE  = 10000,
+    MAX_NUM_REPEAT    = 100,
+    MAX_NUM_ARGUMENT  = 8,
+    MAX_ARGUMENT_LEN  = 64
+};
+
+
+typedef struct benchquery BenchQuery;
+
+struct benchquery
+{
+    char * name;
+    char * argument[MAX_NUM_ARGUMENT];  // NULL terminated, "@g" and "@p" are replaced by geohash6 and prefix
+};
+
+
+typedef struct benchrun BenchRun;
+
+struct benchrun
+{
+    double wall;       // seconds
+    double firstByte;  // seconds to the first byte of output
+    double user;
+    double sys;
+    long   maxRss;     // KB
+    long   nrByte;
+    int    status;
+};
+
+
+static BenchQuery benchQueries[] =
+{
+    { "all",       { NULL } },
+    { "unordered", { "-u", NULL } },
+    { "geohash",   { "@g", NULL } },
+    { "prefix",    { "@p", NULL } },
+    { "day-time",  { "-d1..7", "-t0700..0930", NULL } },
+    { "sum",       { "-acount,sum,mean", NULL } },
+    { "group",     { "-acount,sum,mean,min,max,stddev", "-kgeohash,day,hour", NULL } },
+    { NULL,        { NULL } }
+};
+
+
+long
+scanDataset( char * path, char * geohash6Argument, char * prefixArgument );
+
+double
+getWallTime( void );
+
+void
+runBenchQuery( char * program, char * * argument, char * dataset, BenchRun * run );
+
+
+/* global variables */
+static char * baseProgramName = NULL;
+
+
+static int
+compareBenchRun( const void * a, const void * b )
+{
+    const BenchRun * ra = a;
+    const BenchRun * rb = b;
+
+
+    return ra->wall < rb->wall ? -1 : ra->wall > rb->wall;
+}
+
+
+int
+main( int argc, char * argv[] )
+{
+    BenchQuery * query;
+    BenchRun     run[MAX_NUM_REPEAT];
+    BenchRun   * median;
+    char         geohash6Argument[MAX_ARGUMENT_LEN];
+    char         prefixArgument[MAX_ARGUMENT_LEN];
+    char       * argument[MAX_NUM_ARGUMENT];
+    char       * dataset;
+    long         nrRow;
+    int          nrRepeat = 3;
+    int          i;
+    int          j;
+    int          k;
+    int          opt;
+
+
+    // initialization
+
+    baseProgramName = strrchr( argv[0], '/' );
+    if ( NULL == baseProgramName )
+    {
+        baseProgramName = argv[0];
+    }
+    else
+    {
+        baseProgramName++;
+    }
+
+    // end of initialization
+
+
+    // program option and argument parsing
+
+    while ( ( opt = getopt( argc, argv, "r:h" ) ) != -1 )
+    {
+        switch ( opt )
+        {
+            case 'h':
+                printf( "OVERVIEW: Benchmark of trafficdemand builds with a standard mix of queries\n" );
+                printf( "\n" );
+                printf( "USAGE: %s [options] dataset program ...\n", baseProgramName );
+                printf( "\n" );
+                printf( "[options]\n" );
+                printf( "    -r3                                Run each query 3 times and report the median, default is 3\n" );
+                printf( "\n\n" );
+                printf( "The queries are all, -u, -g with 3 geohash6, -g with a prefix, -d and -t, -a and -a with -k\n" );
+                printf( "\n" );
+                exit( 0 );
+                break;
+
+            case 'r':
+                nrRepeat = atoi( optarg );
+                if ( nrRepeat < 1
+                     || nrRepeat > MAX_NUM_REPEAT )
+                {
+                    fprintf( stderr, "argument to -r must be 1 to %d\n", MAX_NUM_REPEAT );
+                    exit( 1 );
+                }
+
+                break;
+
+            default:
+                fprintf( stderr, "invalid option (%c) and argument\n", opt );
+                exit( 1 );
+        }
+    }
+
+    argc -= optind;
+    argv += optind;
+
+    if ( argc < 2 )
+    {
+        fprintf( stderr, "USAGE: %s [options] dataset program ...\n", baseProgramName );
+        exit( 1 );
+    }
+
+    dataset = argv[0];
+
+    // end of program option and argument parsing
+
+    nrRow = scanDataset( dataset, geohash6Argument, prefixArgument );
+
+    printf( "dataset %s, %ld rows, %s, %s, median of %d runs\n\n", dataset, nrRow, geohash6Argument, prefixArgument, nrRepeat );
+    printf( "%-24s %-10s %12s %10s %10s %10s %10s %10s %12s %12s\n",
+            "program", "query", "rows/s", "wall ms", "read ms", "output ms", "user ms", "sys ms", "peak RSS KB", "output bytes" );
+
+    for ( i = 1; i < argc; i++ )
+    {
+        for ( query = benchQueries; NULL != query->name; query++ )
+        {
+            for ( j = 0; NULL != query->argument[j]; j++ )
+            {
+                if ( strcmp( query->argument[j], "@g" ) == 0 )
+                {
+                    argument[j] = geohash6Argument;
+                }
+                else if ( strcmp( query->argument[j], "@p" ) == 0 )
+                {
+                    argument[j] = prefixArgument;
+                }
+                else
+                {
+                    argument[j] = query->argument[j];
+                }
+            }
+
+            argument[j] = NULL;
+
+            for ( k = 0; k < nrRepeat; k++ )
+            {
+                runBenchQuery( argv[i], argument, dataset, &( run[k] ) );
+                if ( 0 != run[k].status )
+                {
+                    fprintf( stderr, "%s exits with status %d for query %s\n", argv[i], run[k].status, query->name );
+                    exit( 1 );
+                }
+            }
+
+            qsort( run, nrRepeat, sizeof( run[0] ), compareBenchRun );
+            median = &( run[nrRepeat / 2] );
+
+            printf( "%-24s %-10s %12.0f %10.1f %10.1f %10.1f %10.1f %10.1f %12ld %12ld\n",
+                    argv[i],
+                    query->name,
+                    median->wall > 0.0 ? nrRow / median->wall : 0.0,
+                    median->wall * 1000.0,
+                    median->firstByte * 1000.0,
+                    ( median->wall - median->firstByte ) * 1000.0,
+                    median->user * 1000.0,
+                    median->sys * 1000.0,
+                    median->maxRss,
+                    median->nrByte );
+            fflush( stdout );
+        }
+    }
+
+    return 0;
+}
+
+
+/* the function returns the number of lines after the header, and picks the first
+ * geohash6 values of the dataset as the -g argument and the prefix of the first one.
+ */
+long
+scanDataset( char * path, char * geohash6Argument, char * prefixArgument )
+{
+    FILE * file;
+    char   buf[BUFSIZ];
+    long   nrLine = 0;
+    int    nrGeohash6 = 0;
+    int    isLineStart = 1;
+    size_t len;
+
+
+    file = fopen( path, "r" );
+    if ( NULL == file )
+    {
+        fprintf( stderr, "open file error: %s\n", path );
+        exit( 1 );
+    }
+
+    strcpy( geohash6Argument, "-g" );
+    strcpy( prefixArgument, "-g" );
+
+    while ( fgets( buf, sizeof( buf ), file ) != NULL )
+    {
+        len = strlen( buf );
+
+        if ( isLineStart
+             && nrLine > 0
+             && nrLine < NUM_SCANNED_LINE
+             && nrGeohash6 < NUM_GEOHASH6
+             && len > GEOHASH6_LEN
+             && ',' == buf[GEOHASH6_LEN] )
+        {
+            buf[GEOHASH6_LEN] = '\0';
+
+            if ( NULL == strstr( geohash6Argument, buf ) )
+            {
+                if ( 0 == nrGeohash6 )
+                {
+                    snprintf( prefixArgument, MAX_ARGUMENT_LEN, "-g%.*s*", GEOHASH6_LEN - 2, buf );
+                }
+                else
+                {
+                    strcat( geohash6Argument, "," );
+                }
+
+                strcat( geohash6Argument, buf );
+                nrGeohash6++;
+            }
+
+            buf[GEOHASH6_LEN] = ',';
+        }
+
+        isLineStart = ( len > 0 && '\n' == buf[len - 1] );
+        if ( isLineStart )
+        {
+            nrLine++;
+        }
+    }
+
+    fclose( file );
+
+    if ( 0 == nrGeohash6 )
+    {
+        fprintf( stderr, "no geohash6 is found in %s\n", path );
+        exit( 1 );
+    }
+
+    return nrLine > 0 ? nrLine - 1 : 0;
+}
+
+
+double
+getWallTime( void )
+{
+    struct timespec ts;
+
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+/* the function runs program with argument and dataset, and reads its output from a pipe
+ * so that the time to the first byte is known.
+ */
+void
+runBenchQuery( char * program, char * * argument, char * dataset, BenchRun * run )
+{
+    char          * childArgument[MAX_NUM_ARGUMENT + 2];
+    char            buf[BUFSIZ * 16];
+    struct rusage   usage;
+    ssize_t         n;
+    double          start;
+    pid_t           pid;
+    int             fd[2];
+    int             status;
+    int             i;
+
+
+    childArgument[0] = program;
+    for ( i = 0; NULL != argument[i]; i++ )
+    {
+        childArgument[i + 1] = argument[i];
+    }
+
+    childArgument[i + 1] = dataset;
+    childArgument[i + 2] = NULL;
+
+    if ( pipe( fd ) < 0 )
+    {
+        fprintf( stderr, "failed to create pipe: %s\n", strerror( errno ) );
+        exit( 1 );
+    }
+
+    start = getWallTime();
+
+    pid = fork();
+    if ( pid < 0 )
+    {
+        fprintf( stderr, "failed to fork: %s\n", strerror( errno ) );
+        exit( 1 );
+    }
+    else if ( 0 == pid )
+    {
+        close( fd[0] );
+        dup2( fd[1], STDOUT_FILENO );
+        close( fd[1] );
+
+        execv( program, childArgument );
+
+        fprintf( stderr, "failed to run %s: %s\n", program, strerror( errno ) );
+        _exit( 127 );
+    }
+
+    close( fd[1] );
+
+    run->firstByte = -1.0;
+    run->nrByte = 0;
+
+    while ( ( n = read( fd[0], buf, sizeof( buf ) ) ) != 0 )
+    {
+        if ( n < 0 )
+        {
+            if ( EINTR == errno )
+            {
+                continue;
+            }
+
+            fprintf( stderr, "failed to read output of %s: %s\n", program, strerror( errno ) );
+            exit( 1 );
+        }
+
+        if ( run->firstByte < 0.0 )
+        {
+            run->firstByte = getWallTime() - start;
+        }
+
+        run->nrByte += n;
+    }
+
+    close( fd[0] );
+
+    if ( wait4( pid, &status, 0, &usage ) < 0 )
+    {
+        fprintf( stderr, "failed to wait for %s: %s\n", program, strerror( errno ) );
+        exit( 1 );
+    }
+
+    run->wall = getWallTime() - start;
+    if ( run->firstByte < 0.0 )
+    {
+        run->firstByte = run->wall;
+    }
+
+    run->user = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6;
+    run->sys = usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+    run->maxRss = usage.ru_maxrss;
+    run->status = WIFEXITED( status ) ? WEXITSTATUS( status ) : 128 + WTERMSIG( status );
+}
@@ -0,0 +1,200 @@
+#!/bin/sh
+#
+# Copyright 2019, Chee Bin Hoh, All right reserved.
+#
+# This script checks a build of trafficdemand.c against a baseline build, for example one from
+# before demand values are parsed and printed without atof and printf. A dataset of values
+# that are hard to parse and print is generated by gendemand.c -vedge, and the -u, ordered and
+# aggregate output of both builds over it, read from the file and from standard input, must be
+# byte identical. The options after the builds are given to gendemand. Both builds are compiled
+# with the same compiler and options, as the sign of a nan sum depends on the order of adding.
+# The queries that the baseline does not answer, like percentiles of inf, -inf and nan, are
+# run by the build alone, and its output from standard input and with one thread must be the
+# same as from the file, where it has to succeed. The build then writes a cache and a cube file
+# of the dataset, the output of a query over the cache must be byte identical to over the csv,
+# and over the cube the counts must be identical and the sums and means within a relative
+# tolerance of 1e-9, as the cube adds a range from double-double prefix sums and the csv one
+# demand at a time, which may be off by n x 2^-53 of the sum of absolute demands, inf, -inf and
+# nan must be the same apart from the sign of nan.
+#
+# USAGE: ./diffdemand.sh baseline/a.out ./a.out [-n200 -d30 -r0.2 -s1]
+#
+
+
+if [ $# -lt 2 ]
+then
+    echo "USAGE: $0 baseline-build build [gendemand options]" >&2
+    exit 1
+fi
+
+baseline=$1
+build=$2
+shift 2
+
+dir=$( dirname "$0" )
+tmp=$( mktemp -d ) || exit 1
+trap 'rm -rf "$tmp"' EXIT
+
+cc -O2 "$dir/gendemand.c" -o "$tmp/gendemand" -lm || exit 1
+
+if [ $# -eq 0 ]
+then
+    set -- -n200 -d30 -r0.2 -s1
+fi
+
+"$tmp/gendemand" -vedge "$@" > "$tmp/edge.csv" || exit 1
+
+
+# each query is run by both builds over the file and over standard input, with the status
+
+nrDiff=0
+
+while read -r query
+do
+    for input in file stdin
+    do
+        for program in "$baseline" "$build"
+        do
+            output="$tmp/build.out"
+            [ "$program" = "$baseline" ] && output="$tmp/baseline.out"
+
+            if [ "$input" = file ]
+            then
+                $program $query "$tmp/edge.csv" > "$output" 2>&1
+            else
+                $program $query < "$tmp/edge.csv" > "$output" 2>&1
+            fi
+
+            echo "status $?" >> "$output"
+        done
+
+        if ! cmp -s "$tmp/baseline.out" "$tmp/build.out"
+        then
+            echo "DIFF: $query ($input)"
+            diff "$tmp/baseline.out" "$tmp/build.out" | head -6
+            nrDiff=$(( nrDiff + 1 ))
+        fi
+    done
+done <<QUERIES
+-u
+-u -j1
+-j1
+-j4
+-acount,sum,mean,min,max,stddev
+-acount,sum,mean,min,max,stddev -j1
+-acount,sum,mean,min,max,stddev -kgeohash
+-acount,sum,mean,min,max,stddev -kday,hour
+-acount,sum,mean,min,max,stddev -kgeohash,day,interval
+-u -d3..9 -t0100..1245
+-asum,mean -kgeohash -d3..9 -t0100..1245
+QUERIES
+
+
+# each query of the build alone is run over the file, and then over standard input and with 
+# one thread
+
+while read -r query
+do
+    $build $query "$tmp/edge.csv" > "$tmp/file.out" 2>&1
+    status=$?
+
+    if [ $status -ne 0 ]
+    then
+        echo "FAILED: $query (status $status)"
+        head -3 "$tmp/file.out"
+        nrDiff=$(( nrDiff + 1 ))
+        continue
+    fi
+
+    for input in stdin j1
+    do
+        if [ "$input" = stdin ]
+        then
+            $build $query < "$tmp/edge.csv" > "$tmp/build.out" 2>&1
+        else
+            $build $query -j1 "$tmp/edge.csv" > "$tmp/build.out" 2>&1
+        fi
+
+        if ! cmp -s "$tmp/file.out" "$tmp/build.out"
+        then
+            echo "DIFF: $query ($input)"
+            diff "$tmp/file.out" "$tmp/build.out" | head -6
+            nrDiff=$(( nrDiff + 1 ))
+        fi
+    done
+done <<QUERIES
+-ap50,p90,p99,distinct -kgeohash
+-ap50,p90,p99 -kday,hour
+-ap50,p99,min,max -kgeohash,day,interval
+QUERIES
+
+
+# each query is run by the build over the csv and over the cache or cube file built from it
+
+if ! $build --build-cache="$tmp/edge.cache" "$tmp/edge.csv" > "$tmp/build.out" 2>&1 \
+   || ! $build --build-cube="$tmp/edge.cube" "$tmp/edge.csv" >> "$tmp/build.out" 2>&1
+then
+    echo "FAILED: --build-cache or --build-cube"
+    head -3 "$tmp/build.out"
+    exit 1
+fi
+
+while read -r file query
+do
+    $build $query "$tmp/edge.csv" > "$tmp/file.out" 2>&1
+    echo "status $?" >> "$tmp/file.out"
+    $build $query "$tmp/edge.$file" > "$tmp/build.out" 2>&1
+    echo "status $?" >> "$tmp/build.out"
+
+    if [ "$file" = cache ]
+    then
+        cmp -s "$tmp/file.out" "$tmp/build.out"
+    else
+        awk -F, '
+            NR == FNR { line[FNR] = $0; next }
+            {
+                n = split( line[FNR], field, "," )
+                if ( n != NF ) exit 1
+                for ( i = 1; i <= NF; i++ )
+                {
+                    if ( field[i] == $i || ( field[i] ~ /nan/ && $i ~ /nan/ ) ) continue
+                    if ( field[i] ~ /inf|nan|[a-z]/ || $i ~ /inf|nan|[a-z]/ ) exit 1
+                    a = field[i] + 0; b = $i + 0
+                    d = a > b ? a - b : b - a
+                    m = a < 0 ? -a : a; if ( b > m ) m = b; if ( -b > m ) m = -b
+                    if ( d > 1e-9 * m ) exit 1
+                }
+            }
+            END { if ( FNR != length( line ) ) exit 1 }' "$tmp/file.out" "$tmp/build.out"
+    fi
+
+    if [ $? -ne 0 ]
+    then
+        echo "DIFF: $query ($file)"
+        diff "$tmp/file.out" "$tmp/build.out" | head -6
+        nrDiff=$(( nrDiff + 1 ))
+    fi
+done <<QUERIES
+cache -u
+cache -j1
+cache -amin,max
+cache -amin,max -kgeohash
+cache -acount,sum,mean -kgeohash
+cache -acount,sum,mean,min,max,stddev -kgeohash,day,interval
+cache -u -d3..9 -t0100..1245
+cache -acount,sum,mean,min,max -kgeohash -d3..9 -t0100..1245
+cube -acount,sum,mean
+cube -acount,sum,mean -kgeohash
+cube -acount,sum,mean -kgeohash -d3..9 -t0100..1245
+cube -asum,mean -d2,4..6 -t0000..0130,2000..2345
+QUERIES
+
+rows=$( wc -l < "$tmp/edge.csv" )
+
+if [ $nrDiff -gt 0 ]
+then
+    echo "$nrDiff of the outputs differ over $rows lines"
+    exit 1
+fi
+
+echo "all outputs are the same over $rows lines"
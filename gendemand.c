@@ -0,0 +1,444 @@
+/*
+ * Copyright 2019, Chee Bin Hoh, All right reserved.
+ *
+ * This program generates a synthetic traffic demand dataset in the format read by trafficdemand.c,
+ * with a given number of geohash6, days, density of demands and distribution of values. The same
+ * options and seed always generate the same dataset. The edge distribution writes values that
+ * are hard to parse and print exactly, to check one build of trafficdemand.c against another.
+ *
+ */
+
+
+#define _POSIX_C_SOURCE 200809L
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <stdint.h>
+
+
+enum
+{
+    MIN_IN_MININTERVAL   = 15,
+    MININTERVALS_IN_DAY  = 4,
+    HOURS_IN_DAY         = 24,
+    DAYS_IN_YEAR         = 365,
+    GEOHASH6_LEN         = 6,
+    BITS_IN_GEOHASH_CHAR = 5,
+    MAX_VALUE_LEN        = 32
+};
+
+
+enum
+{
+    DISTRIBUTION_UNIFORM,
+    DISTRIBUTION_SKEWED,
+    DISTRIBUTION_EXPONENTIAL,
+    DISTRIBUTION_EDGE,
+    NUM_DISTRIBUTION
+};
+
+
+static const char base32Geohash[] = "0123456789bcdefghjkmnpqrstuvwxyz";
+
+static const char * distributionNames[NUM_DISTRIBUTION] = { "uniform", "skewed", "exponential", "edge" };
+
+
+/* values at the edges of parsing and printing, signed zeros, partial numbers, hex, inf and
+ * nan, subnormals, the largest doubles, more digits than a double holds, integers beyond 2^53,
+ * powers of 10 beyond 10^22, and ties of rounding to 18 decimals.
+ */
+static const char * edgeValues[] =
+{
+    "-0", "0", ".5", "5.", "1e", "1e+", "0x1p3", "inf", "-inf", "nan", "", "1.5", "+2.25", "1.5x",
+    "1e-300", "4.9e-324", "2.2250738585072014e-308", "1e300", "1.7976931348623157e308",
+    "123456789012345678901234", "0.30000000000000004", "9007199254740993", "9007199254740992",
+    "1e22", "1e23", "12345e-30", "0.000000000000000000500", "0.0000000000000000005",
+    "0.0000000000000000015", "0.0000000000000000025", "2.5e-18", "1.5e-18",
+    "99999999999999999999e-20", "abc"
+};
+
+
+/* Start of random API
+ *
+ * The random numbers are generated by splitmix64, so the dataset does not depend on the
+ * rand() of the C library.
+ */
+
+uint64_t
+nextRandom( uint64_t * state );
+
+double
+nextRandomFraction( uint64_t * state );
+
+double
+nextRandomValue( uint64_t * state, int distribution );
+
+/* End of random API */
+
+
+char *
+formatValue( double value, char * s );
+
+char *
+formatEdgeValue( uint64_t * state, char * s );
+
+
+/* global variables */
+static char * baseProgramName = NULL;
+
+
+int
+main( int argc, char * argv[] )
+{
+    char     * prefix = "qp0";
+    long       nrGeohash6 = 1300;
+    int        nrDay = 61;
+    double     density = 0.1;
+    int        distribution = DISTRIBUTION_SKEWED;
+    uint64_t   seed = 1;
+    uint64_t   state;
+    uint64_t   range;
+    uint64_t   stride;
+    uint64_t   offset;
+    uint64_t   code;
+    uint64_t   prefixCode = 0;
+    int        nrSuffixChar;
+    char     * geohash6;
+    char       value[MAX_VALUE_LEN];
+    long       i;
+    int        day;
+    int        minInterval;
+    int        j;
+    int        opt;
+
+
+    // initialization
+
+    baseProgramName = strrchr( argv[0], '/' );
+    if ( NULL == baseProgramName )
+    {
+        baseProgramName = argv[0];
+    }
+    else
+    {
+        baseProgramName++;
+    }
+
+    // end of initialization
+
+
+    // program option and argument parsing
+
+    while ( ( opt = getopt( argc, argv, "n:p:d:r:v:s:h" ) ) != -1 )
+    {
+        switch ( opt )
+        {
+            case 'h':
+                printf( "OVERVIEW: Synthetic traffic demand dataset generator\n" );
+                printf( "\n" );
+                printf( "USAGE: %s [options]\n", baseProgramName );
+                printf( "\n" );
+                printf( "[options]\n" );
+                printf( "    -n1300                             Number of geohash6, default is 1300\n" );
+                printf( "    -pqp0                              Prefix of all geohash6, default is qp0\n" );
+                printf( "    -d61                               Number of days starting from day 1, default is 61\n" );
+                printf( "    -r0.1                              Chance of a demand for each geohash6 and 15 minutes, default is 0.1\n" );
+                printf( "    -vskewed                           Distribution of values from 0 to 1, uniform, skewed (default) or exponential,\n" );
+                printf( "                                       or edge for values that are hard to parse and print\n" );
+                printf( "    -s1                                Seed of the random numbers, default is 1\n" );
+                printf( "\n\n" );
+                printf( "The dataset is written to standard output in the order of day and time\n" );
+                printf( "\n" );
+                exit( 0 );
+                break;
+
+            case 'n':
+                nrGeohash6 = atol( optarg );
+                if ( nrGeohash6 <= 0 )
+                {
+                    fprintf( stderr, "argument to -n must be more than 0\n" );
+                    exit( 1 );
+                }
+
+                break;
+
+            case 'p':
+                prefix = optarg;
+                break;
+
+            case 'd':
+                nrDay = atoi( optarg );
+                if ( nrDay <= 0
+                     || nrDay > DAYS_IN_YEAR )
+                {
+                    fprintf( stderr, "argument to -d must be 1 and less than 366\n" );
+                    exit( 1 );
+                }
+
+                break;
+
+            case 'r':
+                density = atof( optarg );
+                if ( density <= 0.0
+                     || density > 1.0 )
+                {
+                    fprintf( stderr, "argument to -r must be more than 0 and up to 1\n" );
+                    exit( 1 );
+                }
+
+                break;
+
+            case 'v':
+                for ( distribution = 0; distribution < NUM_DISTRIBUTION; distribution++ )
+                {
+                    if ( strcmp( optarg, distributionNames[distribution] ) == 0 )
+                    {
+                        break;
+                    }
+                }
+
+                if ( distribution >= NUM_DISTRIBUTION )
+                {
+                    fprintf( stderr, "Invalid argument to -v%s, it is uniform, skewed, exponential or edge\n", optarg );
+                    exit( 1 );
+                }
+
+                break;
+
+            case 's':
+                seed = strtoull( optarg, NULL, 10 );
+                break;
+
+            default:
+                fprintf( stderr, "invalid option (%c) and argument\n", opt );
+                exit( 1 );
+        }
+    }
+
+    nrSuffixChar = GEOHASH6_LEN - ( int ) strlen( prefix );
+    if ( nrSuffixChar <= 0 )
+    {
+        fprintf( stderr, "Invalid argument to -p%s, it must be shorter than 6 characters\n", prefix );
+        exit( 1 );
+    }
+
+    for ( j = 0; '\0' != prefix[j]; j++ )
+    {
+        if ( NULL == strchr( base32Geohash, prefix[j] ) )
+        {
+            fprintf( stderr, "Invalid argument to -p%s, %c is not a geohash character\n", prefix, prefix[j] );
+            exit( 1 );
+        }
+
+        prefixCode = ( prefixCode << BITS_IN_GEOHASH_CHAR ) | ( strchr( base32Geohash, prefix[j] ) - base32Geohash );
+    }
+
+    range = ( uint64_t ) 1 << ( nrSuffixChar * BITS_IN_GEOHASH_CHAR );
+    if ( ( uint64_t ) nrGeohash6 > range )
+    {
+        fprintf( stderr, "argument to -n must be up to %lu for prefix %s\n", ( unsigned long ) range, prefix );
+        exit( 1 );
+    }
+
+    // end of program option and argument parsing
+
+
+    // geohash6 values are distinct suffixes spread over the prefix, an odd stride is
+    // a permutation of the suffixes because their number is a power of 2
+
+    geohash6 = malloc( nrGeohash6 * ( GEOHASH6_LEN + 1 ) );
+    if ( NULL == geohash6 )
+    {
+        fprintf( stderr, "failed to allocate memory for geohash6\n" );
+        exit( 1 );
+    }
+
+    state = seed;
+    stride = nextRandom( &state ) | 1;
+    offset = nextRandom( &state );
+
+    for ( i = 0; i < nrGeohash6; i++ )
+    {
+        code = ( prefixCode << ( nrSuffixChar * BITS_IN_GEOHASH_CHAR ) ) | ( ( offset + i * stride ) & ( range - 1 ) );
+
+        for ( j = GEOHASH6_LEN - 1; j >= 0; j-- )
+        {
+            geohash6[i * ( GEOHASH6_LEN + 1 ) + j] = base32Geohash[code & ( ( 1 << BITS_IN_GEOHASH_CHAR ) - 1 )];
+            code >>= BITS_IN_GEOHASH_CHAR;
+        }
+
+        geohash6[i * ( GEOHASH6_LEN + 1 ) + GEOHASH6_LEN] = '\0';
+    }
+
+    // the timestamp is written like the training dataset, 9:0 rather than 09:00
+
+    printf( "geohash6,day,timestamp,demand\n" );
+
+    for ( day = 1; day <= nrDay; day++ )
+    {
+        for ( minInterval = 0; minInterval < MININTERVALS_IN_DAY * HOURS_IN_DAY; minInterval++ )
+        {
+            for ( i = 0; i < nrGeohash6; i++ )
+            {
+                if ( nextRandomFraction( &state ) < density )
+                {
+                    if ( DISTRIBUTION_EDGE == distribution )
+                    {
+                        formatEdgeValue( &state, value );
+                    }
+                    else
+                    {
+                        formatValue( nextRandomValue( &state, distribution ), value );
+                    }
+
+                    printf( "%s,%d,%d:%d,%s\n",
+                            &( geohash6[i * ( GEOHASH6_LEN + 1 )] ),
+                            day,
+                            minInterval / MININTERVALS_IN_DAY,
+                            ( minInterval % MININTERVALS_IN_DAY ) * MIN_IN_MININTERVAL,
+                            value );
+                }
+            }
+        }
+    }
+
+    free( geohash6 );
+
+    return 0;
+}
+
+
+/* Start of random API */
+
+uint64_t
+nextRandom( uint64_t * state )
+{
+    uint64_t z;
+
+
+    z = ( *state += 0x9e3779b97f4a7c15ULL );
+    z = ( z ^ ( z >> 30 ) ) * 0xbf58476d1ce4e5b9ULL;
+    z = ( z ^ ( z >> 27 ) ) * 0x94d049bb133111ebULL;
+
+    return z ^ ( z >> 31 );
+}
+
+
+/* the function returns a random number from 0 to less than 1 with 53 bits.
+ */
+double
+nextRandomFraction( uint64_t * state )
+{
+    return ( nextRandom( state ) >> 11 ) * ( 1.0 / ( ( uint64_t ) 1 << 53 ) );
+}
+
+
+/* the function returns a random value from 0 to 1, skewed values are mostly small
+ * like the training dataset, and exponential values have mean 0.125 and are cut at 1.
+ */
+double
+nextRandomValue( uint64_t * state, int distribution )
+{
+    double u;
+    double value = 0.0;
+
+
+    u = nextRandomFraction( state );
+
+    switch ( distribution )
+    {
+        case DISTRIBUTION_UNIFORM:
+            value = u;
+            break;
+
+        case DISTRIBUTION_SKEWED:
+            value = u * u * u;
+            break;
+
+        case DISTRIBUTION_EXPONENTIAL:
+            value = -log( 1.0 - u ) / 8.0;
+            value = ( value > 1.0 ) ? 1.0 : value;
+            break;
+    }
+
+    return value;
+}
+
+/* End of random API */
+
+
+/* the function writes the shortest digits that are read back as the same value.
+ */
+char *
+formatValue( double value, char * s )
+{
+    int precision;
+
+
+    for ( precision = 15; precision < 17; precision++ )
+    {
+        snprintf( s, MAX_VALUE_LEN, "%.*g", precision, value );
+        if ( strtod( s, NULL ) == value )
+        {
+            return s;
+        }
+    }
+
+    snprintf( s, MAX_VALUE_LEN, "%.17g", value );
+
+    return s;
+}
+
+
+/* the function writes one of the edge values, or a random value in one of the forms that 
+ * the edge values are in: any magnitude and number of significant digits with an exponent, 
+ * an integer mantissa with an exponent, or a fixed number of decimals.
+ */
+char *
+formatEdgeValue( uint64_t * state, char * s )
+{
+    double   u;
+    int      sign;
+    int      exponent;
+    int      digits;
+    uint64_t mantissa;
+
+
+    u = nextRandomFraction( state );
+    sign = ( nextRandom( state ) & 1 ) ? -1 : 1;
+
+    switch ( nextRandom( state ) % 5 )
+    {
+        case 0:
+            snprintf( s, MAX_VALUE_LEN, "%s", edgeValues[nextRandom( state ) % ( sizeof( edgeValues ) / sizeof( edgeValues[0] ) )] );
+            break;
+
+        case 1:
+            exponent = ( int )( nextRandom( state ) % 601 ) - 300;
+            digits = 1 + ( int )( nextRandom( state ) % 17 );
+            snprintf( s, MAX_VALUE_LEN, "%.*g", digits, sign * u * pow( 10.0, exponent ) );
+            break;
+
+        case 2:
+            mantissa = nextRandom( state ) >> ( nextRandom( state ) % 64 );
+            exponent = ( int )( nextRandom( state ) % 61 ) - 30;
+            snprintf( s, MAX_VALUE_LEN, "%llue%d", ( unsigned long long ) mantissa, exponent );
+            break;
+
+        case 3:
+            exponent = ( int )( nextRandom( state ) % 5 );
+            digits = ( int )( nextRandom( state ) % 21 );
+            snprintf( s, MAX_VALUE_LEN, "%.*f", digits, sign * u * pow( 10.0, exponent ) );
+            break;
+
+        default:
+            formatValue( u * u * u, s );
+            break;
+    }
+
+    return s;
+}
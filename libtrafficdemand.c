@@ -0,0 +1,7054 @@
+/*
+ * Copyright 2019, Chee Bin Hoh, All right reserved.
+ *
+ * This is the traffic demand library, its public interface is trafficdemand.h and the rest
+ * of its interface is libtrafficdemand.h.
+ *
+ */
+
+
+#define _POSIX_C_SOURCE 200809L
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <assert.h>
+#include <math.h>
+#include <errno.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/resource.h>
+#include <sys/uio.h>
+#include <time.h>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#if defined( __GNUC__ ) && defined( __x86_64__ )
+#include <immintrin.h>
+#define HAVE_AVX2_KERNEL
+#endif
+
+#include "libtrafficdemand.h"
+
+
+/* Start of DemandInGeohash6 API */
+
+static const char base32Geohash[] = "0123456789bcdefghjkmnpqrstuvwxyz";
+
+
+/* the function returns the 5 bits value of a base32 geohash character, or -1 when it is not 
+ * one of them, geohash base32 is 0 to 9 and b to z without i, l and o.
+ */
+int
+getValueOfGeohashChar( int c )
+{
+    if ( c >= '0' && c <= '9' )
+    {
+        return c - '0';
+    }
+    else if ( c >= 'b' && c <= 'h' )
+    {
+        return c - 'b' + 10;
+    }
+    else if ( c == 'j' || c == 'k' )
+    {
+        return c - 'j' + 17;
+    }
+    else if ( c == 'm' || c == 'n' )
+    {
+        return c - 'm' + 19;
+    }
+    else if ( c >= 'p' && c <= 'z' )
+    {
+        return c - 'p' + 21;
+    }
+
+    return -1;
+}
+
+
+/* the function returns the 30 bits value of a geohash6, or -1 when it is not 6 base32 
+ * characters. The base32 characters are in ascending order, so the encoded values are 
+ * sorted the same way as the geohash6 strings.
+ */
+long
+encodeGeohash6( char * s )
+{
+    long result = 0;
+    int  value;
+    int  i;
+
+
+    for ( i = 0; i < GEOHASH6_LEN; i++ )
+    {
+        if ( ( value = getValueOfGeohashChar( s[i] ) ) < 0 )
+        {
+            return -1;
+        }
+
+        result = ( result << BITS_IN_GEOHASH_CHAR ) | value;
+    }
+
+    return ( '\0' == s[i] ) ? result : -1;
+}
+
+
+char *
+decodeGeohash6( uint32_t geohash6, char * s )
+{
+    int i;
+
+
+    for ( i = GEOHASH6_LEN - 1; i >= 0; i-- )
+    {
+        s[i] = base32Geohash[geohash6 & ( ( 1 << BITS_IN_GEOHASH_CHAR ) - 1 )];
+        geohash6 >>= BITS_IN_GEOHASH_CHAR;
+    }
+
+    s[GEOHASH6_LEN] = '\0';
+
+    return s;
+}
+
+
+/* the hash value is no longer used to place a geohash6, but to keep the order of the 
+ * output the same as when DemandInGeohash6 objects were chained in NUM_HASH_SIZE buckets.
+ */
+long
+getHashValueOfString( char * s )
+{
+    long result;
+    int  c;
+
+
+    result = 0;
+    while ( ( c = *s++ )  != '\0' )
+    {
+        result = result * HASH_MULTIPLIER + c;   
+    }
+
+    return result % NUM_HASH_SIZE;
+}
+
+
+static DemandInGeohash6Slot *
+newDemandInGeohash6Slot( long nrSlot )
+{
+    DemandInGeohash6Slot * slot;
+    long                   i;
+
+
+    slot = malloc( nrSlot * sizeof( slot[0] ) );
+    if ( NULL == slot )
+    {
+        fprintf( stderr, "failed to allocte memory for more DemandInGeohash6Slot\n" );
+        exit( 1 );
+    }
+
+    for ( i = 0; i < nrSlot; i++ )
+    {
+        slot[i].geohash6 = EMPTY_GEOHASH6;
+        slot[i].id = -1;
+    }
+
+    return slot;
+}
+
+
+DemandInGeohash6Table *
+newDemandInGeohash6( void )
+{
+    DemandInGeohash6Table * digh6 = NULL;
+
+
+    digh6 = malloc( sizeof( *digh6 ) );
+    if ( NULL == digh6 )
+    {
+        fprintf( stderr, "failed to allocte memory for more DemandInGeohash6Table\n" );
+        exit( 1 );
+    }
+
+    digh6->nrGeohash6 = 0;
+    digh6->maxGeohash6 = 0;
+    digh6->item = NULL;
+    digh6->nrSlot = MIN_NUM_GEOHASH6_SLOT;
+    digh6->slot = newDemandInGeohash6Slot( digh6->nrSlot );
+
+    return digh6;
+}
+
+
+void
+deleteDemandInGeohash6( DemandInGeohash6Table * digh6 )
+{
+    free( digh6->item );
+    free( digh6->slot );
+    free( digh6 );
+}
+
+
+/* Fibonacci hashing spreads the consecutive geohash6 values of nearby cells over the slots,
+ * nrSlot is always power of 2.
+ */
+static long
+getSlotOfGeohash6( DemandInGeohash6Table * digh6, uint32_t geohash6 )
+{
+    return ( ( uint32_t )( geohash6 * 2654435769U ) ) & ( digh6->nrSlot - 1 );
+}
+
+
+static void
+growDemandInGeohash6( DemandInGeohash6Table * digh6 )
+{
+    DemandInGeohash6     * item;
+    long                   i;
+    long                   j;
+
+
+    if ( digh6->nrGeohash6 >= digh6->maxGeohash6 )
+    {
+        digh6->maxGeohash6 = ( 0 == digh6->maxGeohash6 ) ? MIN_NUM_GEOHASH6_SLOT / 2 : digh6->maxGeohash6 * 2;
+
+        item = realloc( digh6->item, digh6->maxGeohash6 * sizeof( item[0] ) );
+        if ( NULL == item )
+        {
+            fprintf( stderr, "failed to allocate memory for more DemandInGeohash6\n" );
+            exit( 1 );
+        }
+
+        digh6->item = item;
+    }
+
+    if ( ( digh6->nrGeohash6 + 1 ) * 2 > digh6->nrSlot )
+    {
+        free( digh6->slot );
+
+        digh6->nrSlot *= 2;
+        digh6->slot = newDemandInGeohash6Slot( digh6->nrSlot );
+
+        for ( i = 0; i < digh6->nrGeohash6; i++ )
+        {
+            for ( j = getSlotOfGeohash6( digh6, digh6->item[i].geohash6 ); 
+                  EMPTY_GEOHASH6 != digh6->slot[j].geohash6; 
+                  j = ( j + 1 ) & ( digh6->nrSlot - 1 ) )
+            {
+            }
+
+            digh6->slot[j].geohash6 = digh6->item[i].geohash6;
+            digh6->slot[j].id = i;
+        }
+    }
+}
+
+
+DemandInGeohash6 *
+insertGeohash6( DemandInGeohash6Table * digh6, uint32_t geohash6, int createIfNotExist  )
+{
+    long               i;
+    DemandInGeohash6 * hashItem = NULL;
+ 
+
+    for ( i = getSlotOfGeohash6( digh6, geohash6 ); 
+          EMPTY_GEOHASH6 != digh6->slot[i].geohash6; 
+          i = ( i + 1 ) & ( digh6->nrSlot - 1 ) )
+    {   
+        if ( digh6->slot[i].geohash6 == geohash6 )
+        {   
+            return &( digh6->item[digh6->slot[i].id] );
+        }
+    }
+    
+    if ( createIfNotExist )
+    {
+        if ( ( digh6->nrGeohash6 + 1 ) * 2 > digh6->nrSlot
+             || digh6->nrGeohash6 >= digh6->maxGeohash6 )
+        {
+            growDemandInGeohash6( digh6 );
+
+            for ( i = getSlotOfGeohash6( digh6, geohash6 ); 
+                  EMPTY_GEOHASH6 != digh6->slot[i].geohash6; 
+                  i = ( i + 1 ) & ( digh6->nrSlot - 1 ) )
+            {
+            }
+        }
+
+        hashItem = &( digh6->item[digh6->nrGeohash6] );
+        hashItem->geohash6 = geohash6;
+        hashItem->nrDemand = 0;
+
+        digh6->slot[i].geohash6 = geohash6;
+        digh6->slot[i].id = digh6->nrGeohash6++;
+    }
+
+    return hashItem;
+}
+
+
+/* the function returns the most slots walked to find a geohash6 in the table.
+ */
+long
+getLongestProbeOfDemandInGeohash6( DemandInGeohash6Table * digh6 )
+{
+    long i;
+    long probe;
+    long longestProbe = 0;
+
+
+    for ( i = 0; i < digh6->nrSlot; i++ )
+    {
+        if ( EMPTY_GEOHASH6 != digh6->slot[i].geohash6 )
+        {
+            probe = ( ( i - getSlotOfGeohash6( digh6, digh6->slot[i].geohash6 ) ) & ( digh6->nrSlot - 1 ) ) + 1;
+            if ( probe > longestProbe )
+            {
+                longestProbe = probe;
+            }
+        }
+    }
+
+    return longestProbe;
+}
+
+
+DemandInGeohash6 *
+insertDemandInGeohash6( DemandInGeohash6Table * digh6, Demand * d, int createIfNotExist )
+{
+    DemandInGeohash6 * hashItem;
+
+    
+    hashItem = insertGeohash6( digh6, d->geohash6, createIfNotExist );
+
+    if ( NULL != hashItem )
+    {
+        hashItem->nrDemand++;
+    }
+
+    return hashItem;
+}
+
+
+void
+processDemandInGeohash6( DemandInGeohash6Table * digh6, Demand * d, long nrDemand, int createIfNotExist )
+{
+    while ( nrDemand-- > 0 )
+    {
+        insertDemandInGeohash6( digh6, d++, createIfNotExist );
+    }
+}
+
+
+/* End of DemandInGeohash6 API */
+
+
+/* Start of Geohash6Range API */
+
+void
+insertGeohash6Range( DemandFilter * filter, uint32_t from, uint32_t to )
+{
+    Geohash6Range * range;
+
+
+    if ( filter->nrGeohash6 >= filter->maxGeohash6 )
+    {
+        filter->maxGeohash6 = ( 0 == filter->maxGeohash6 ) ? NUM_DEMAND_PER_NODE : filter->maxGeohash6 * 2;
+
+        range = realloc( filter->geohash6, filter->maxGeohash6 * sizeof( range[0] ) );
+        if ( NULL == range )
+        {
+            fprintf( stderr, "failed to allocate memory for more Geohash6Range\n" );
+            exit( 1 );
+        }
+
+        filter->geohash6 = range;
+    }
+
+    filter->geohash6[filter->nrGeohash6].from = from;
+    filter->geohash6[filter->nrGeohash6].to = to;
+    filter->nrGeohash6++;
+}
+
+
+/* the function adds the range of geohash6 under prefix, which is 0 to 6 base32 characters 
+ * followed by *, and returns -1 when it is not.
+ */
+int
+insertGeohash6PrefixRange( DemandFilter * filter, char * prefix )
+{
+    uint32_t value = 0;
+    int      bits;
+    int      c;
+    int      i;
+
+
+    for ( i = 0; ( c = prefix[i] ) != '*'; i++ )
+    {
+        if ( i >= GEOHASH6_LEN
+             || getValueOfGeohashChar( c ) < 0 )
+        {
+            return -1;
+        }
+
+        value = ( value << BITS_IN_GEOHASH_CHAR ) | getValueOfGeohashChar( c );
+    }
+
+    if ( prefix[i + 1] != '\0' )
+    {
+        return -1;
+    }
+
+    bits = ( GEOHASH6_LEN - i ) * BITS_IN_GEOHASH_CHAR;
+    insertGeohash6Range( filter, value << bits, ( value << bits ) | ( ( 1U << bits ) - 1 ) );
+
+    return 0;
+}
+
+
+/* the bits of a geohash interleave longitude and latitude, starting from longitude, and
+ * each bit halves the range of one of them.
+ */
+static void
+getBoxOfGeohash( uint32_t value, int nrChar, double * box )
+{
+    double range[2][2] = { { -90.0, 90.0 }, { -180.0, 180.0 } };
+    int    bits = nrChar * BITS_IN_GEOHASH_CHAR;
+    int    i;
+
+
+    for ( i = 0; i < bits; i++ )
+    {
+        double * r = range[( i + 1 ) % 2];
+        double   mid = ( r[0] + r[1] ) / 2;
+
+
+        if ( ( value >> ( bits - 1 - i ) ) & 1 )
+        {
+            r[0] = mid;
+        }
+        else
+        {
+            r[1] = mid;
+        }
+    }
+
+    box[0] = range[0][0];
+    box[1] = range[1][0];
+    box[2] = range[0][1];
+    box[3] = range[1][1];
+}
+
+
+/* box and query are latitude from, longitude from, latitude to and longitude to. A geohash6 
+ * matches when its center is in the query, so a prefix entirely in the query matches as a 
+ * whole and only prefixes across its border are walked down.
+ */
+static void
+insertGeohash6RangeInBox( DemandFilter * filter, uint32_t prefix, int nrChar, double * query )
+{
+    double box[4];
+    int    bits;
+    int    c;
+
+
+    getBoxOfGeohash( prefix, nrChar, box );
+
+    if ( box[0] > query[2] 
+         || box[2] < query[0]
+         || box[1] > query[3] 
+         || box[3] < query[1] )
+    {
+        return;
+    }
+
+    bits = ( GEOHASH6_LEN - nrChar ) * BITS_IN_GEOHASH_CHAR;
+
+    if ( box[0] >= query[0] 
+         && box[2] <= query[2]
+         && box[1] >= query[1]
+         && box[3] <= query[3] )
+    {
+        insertGeohash6Range( filter, prefix << bits, ( prefix << bits ) | ( ( 1U << bits ) - 1 ) );
+    }
+    else if ( GEOHASH6_LEN == nrChar )
+    {
+        if ( ( box[0] + box[2] ) / 2 >= query[0]
+             && ( box[0] + box[2] ) / 2 <= query[2]
+             && ( box[1] + box[3] ) / 2 >= query[1]
+             && ( box[1] + box[3] ) / 2 <= query[3] )
+        {
+            insertGeohash6Range( filter, prefix, prefix );
+        }
+    }
+    else
+    {
+        for ( c = 0; c < ( 1 << BITS_IN_GEOHASH_CHAR ); c++ )
+        {
+            insertGeohash6RangeInBox( filter, ( prefix << BITS_IN_GEOHASH_CHAR ) | c, nrChar + 1, query );
+        }
+    }
+}
+
+
+/* the function adds the ranges of geohash6 with center in box, which is latitude from, 
+ * longitude from, latitude to and longitude to, and returns -1 when box is not.
+ */
+int
+insertGeohash6BoxRange( DemandFilter * filter, char * box )
+{
+    double   query[4];
+    char   * cptr = box;
+    char   * end;
+    int      i;
+
+
+    for ( i = 0; i < 4; i++ )
+    {
+        query[i] = strtod( cptr, &end );
+        if ( end == cptr
+             || *end != ( ( i < 3 ) ? ',' : '\0' ) )
+        {
+            return -1;
+        }
+
+        cptr = end + 1;
+    }
+
+    if ( query[0] < -90.0 || query[2] > 90.0 || query[0] > query[2]
+         || query[1] < -180.0 || query[3] > 180.0 || query[1] > query[3] )
+    {
+        return -1;
+    }
+
+    insertGeohash6RangeInBox( filter, 0, 0, query );
+
+    // a filter is still in place when no geohash6 is in the box
+
+    if ( NULL == filter->geohash6 )
+    {
+        insertGeohash6Range( filter, 1, 0 );
+        filter->nrGeohash6 = 0;
+    }
+
+    return 0;
+}
+
+
+static int
+compareGeohash6Range( const void * a, const void * b )
+{
+    const Geohash6Range * ra = a;
+    const Geohash6Range * rb = b;
+
+
+    return ( ra->from > rb->from ) - ( ra->from < rb->from );
+}
+
+
+void
+sortGeohash6Range( DemandFilter * filter )
+{
+    long i;
+    long n = 0;
+
+
+    if ( NULL == filter->geohash6 )
+    {
+        return;
+    }
+
+    qsort( filter->geohash6, filter->nrGeohash6, sizeof( filter->geohash6[0] ), compareGeohash6Range );
+
+    // overlapping and adjacent ranges are merged
+
+    for ( i = 0; i < filter->nrGeohash6; i++ )
+    {
+        if ( n > 0 
+             && filter->geohash6[i].from <= ( uint64_t ) filter->geohash6[n - 1].to + 1 )
+        {
+            if ( filter->geohash6[i].to > filter->geohash6[n - 1].to )
+            {
+                filter->geohash6[n - 1].to = filter->geohash6[i].to;
+            }
+        }
+        else
+        {
+            filter->geohash6[n++] = filter->geohash6[i];
+        }
+    }
+
+    filter->nrGeohash6 = n;
+}
+
+
+int
+isGeohash6InFilter( DemandFilter * filter, uint32_t geohash6 )
+{
+    long     low = 0;
+    long     high;
+    long     mid;
+    uint32_t prefix;
+
+
+    if ( NULL == filter->geohash6 )
+    {
+        return 1;
+    }
+
+    if ( NULL != filter->isPrefixAny )
+    {
+        prefix = geohash6 >> ( ( GEOHASH6_LEN - GEOHASH6_PREFIX_LEN ) * BITS_IN_GEOHASH_CHAR );
+
+        if ( ! ( filter->isPrefixAny[prefix / BITS_IN_WORD] >> ( prefix % BITS_IN_WORD ) & 1 ) )
+        {
+            return 0;
+        }
+
+        if ( filter->isPrefixAll[prefix / BITS_IN_WORD] >> ( prefix % BITS_IN_WORD ) & 1 )
+        {
+            return 1;
+        }
+    }
+
+    high = filter->nrGeohash6;
+    while ( low < high )
+    {
+        mid = ( low + high ) / 2;
+
+        if ( filter->geohash6[mid].to < geohash6 )
+        {
+            low = mid + 1;
+        }
+        else
+        {
+            high = mid;
+        }
+    }
+
+    return low < filter->nrGeohash6 
+           && filter->geohash6[low].from <= geohash6;
+}
+
+
+/* the function sets isMatched[i] when geohash6[i] matches filter, geohash6 must be sorted.
+ */
+void
+markGeohash6InFilter( DemandFilter * filter, uint32_t * geohash6, long nrGeohash6, char * isMatched )
+{
+    long i;
+    long low;
+    long high;
+    long mid;
+
+
+    memset( isMatched, NULL == filter->geohash6, nrGeohash6 );
+
+    for ( i = 0; NULL != filter->geohash6 && i < filter->nrGeohash6; i++ )
+    {
+        low = 0;
+        high = nrGeohash6;
+        while ( low < high )
+        {
+            mid = ( low + high ) / 2;
+
+            if ( geohash6[mid] < filter->geohash6[i].from )
+            {
+                low = mid + 1;
+            }
+            else
+            {
+                high = mid;
+            }
+        }
+
+        for ( ; low < nrGeohash6 && geohash6[low] <= filter->geohash6[i].to; low++ )
+        {
+            isMatched[low] = 1;
+        }
+    }
+}
+
+/* End of Geohash6Range API */
+
+
+/* Start of DemandValue API */
+
+static const double powerOf10[] = 
+{ 
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11, 
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 
+};
+
+
+static int
+isDecimalDigit( int c )
+{
+    return c >= '0' && c <= '9';
+}
+
+
+/* the function parses s when it is exact as a double from the mantissa and power of 10, 
+ * and returns the end of the number, or NULL when it is left to strtod.
+ */
+static char *
+parseExactDemandValue( char * s, double * value )
+{
+    uint64_t mantissa = 0;
+    int      nrDigit = 0;
+    int      hasDigit = 0;
+    int      isNegative = 0;
+    int      isExponentNegative = 0;
+    int      exponent = 0;
+    int      power = 0;
+    char   * eptr;
+
+
+    if ( '-' == *s 
+         || '+' == *s )
+    {
+        isNegative = ( '-' == *s++ );
+    }
+
+    // a hexadecimal number is left to strtod
+
+    if ( '0' == s[0] 
+         && ( 'x' == s[1] 
+              || 'X' == s[1] ) )
+    {
+        return NULL;
+    }
+
+    for ( ; isDecimalDigit( *s ); s++, hasDigit = 1 )
+    {
+        if ( nrDigit > 0
+             || '0' != *s )
+        {
+            if ( ++nrDigit > 19 )
+            {
+                return NULL;
+            }
+
+            mantissa = mantissa * 10 + ( *s - '0' );
+        }
+    }
+
+    if ( '.' == *s )
+    {
+        for ( s++; isDecimalDigit( *s ); s++, hasDigit = 1, power-- )
+        {
+            if ( nrDigit > 0
+                 || '0' != *s )
+            {
+                if ( ++nrDigit > 19 )
+                {
+                    return NULL;
+                }
+
+                mantissa = mantissa * 10 + ( *s - '0' );
+            }
+        }
+    }
+
+    if ( ! hasDigit )
+    {
+        return NULL;
+    }
+
+    // the exponent is only part of the number when it has a digit, like strtod
+
+    if ( 'e' == *s 
+         || 'E' == *s )
+    {
+        eptr = s + 1;
+        if ( '-' == *eptr 
+             || '+' == *eptr )
+        {
+            isExponentNegative = ( '-' == *eptr++ );
+        }
+
+        if ( isDecimalDigit( *eptr ) )
+        {
+            for ( ; isDecimalDigit( *eptr ); eptr++ )
+            {
+                if ( exponent < 10000 )
+                {
+                    exponent = exponent * 10 + ( *eptr - '0' );
+                }
+            }
+
+            power += isExponentNegative ? -exponent : exponent;
+            s = eptr;
+        }
+    }
+
+    if ( 0 == mantissa )
+    {
+        *value = isNegative ? -0.0 : 0.0;
+    }
+    else if ( mantissa > ( ( uint64_t ) 1 << 53 )
+              || power < -22 
+              || power > 22 )
+    {
+        return NULL;
+    }
+    else
+    {
+        *value = ( power < 0 ) ? ( double ) mantissa / powerOf10[-power] : ( double ) mantissa * powerOf10[power];
+        if ( isNegative )
+        {
+            *value = -*value;
+        }
+    }
+
+    return s;
+}
+
+
+/* the function parses the number at the start of s like strtod, and returns the end of it.
+ */
+char *
+parseDemandValue( char * s, double * value )
+{
+    char * end;
+
+
+    end = parseExactDemandValue( s, value );
+    if ( NULL == end )
+    {
+        *value = strtod( s, &end );
+    }
+
+    return end;
+}
+
+
+/* the function writes value with 18 decimals into s like printf( "%.18lf" ) and returns s, 
+ * s must have room for MAX_VALUE_LEN characters.
+ */
+char *
+formatDemandValue( double value, char * s )
+{
+#ifdef __SIZEOF_INT128__
+    static const uint64_t scale = 1000000000000000000ULL;  // 10^18 
+    uint64_t              bits;
+    uint64_t              mantissa;
+    uint64_t              integer;
+    uint64_t              fraction;
+    __uint128_t           product;
+    __uint128_t           rest;
+    __uint128_t           half;
+    int                   exponent;
+    int                   shift;
+    char                  digits[20];
+    char                * cptr = s;
+    int                   n = 0;
+    int                   i;
+
+
+    memcpy( &bits, &value, sizeof( bits ) );
+    exponent = ( bits >> 52 ) & 0x7ff;
+    mantissa = bits & ( ( ( uint64_t ) 1 << 52 ) - 1 );
+
+    // value is mantissa * 2^-shift, with the implicit leading bit unless it is subnormal
+
+    if ( 0 == exponent )
+    {
+        shift = 1074;
+    }
+    else
+    {
+        mantissa |= ( uint64_t ) 1 << 52;
+        shift = 1075 - exponent;
+    }
+
+    if ( exponent != 0x7ff 
+         && shift > 0 )
+    {
+        // mantissa * 10^18 is less than 2^113, so it rounds to 0 when shift is 128 or more
+
+        product = ( __uint128_t ) mantissa * scale;
+        if ( shift >= 128 )
+        {
+            product = 0;
+        }
+        else
+        {
+            rest = product & ( ( ( __uint128_t ) 1 << shift ) - 1 );
+            half = ( __uint128_t ) 1 << ( shift - 1 );
+            product >>= shift;
+
+            if ( rest > half 
+                 || ( rest == half 
+                      && ( product & 1 ) ) )
+            {
+                product++;
+            }
+        }
+
+        integer = product / scale;
+        fraction = product % scale;
+
+        if ( bits >> 63 )
+        {
+            *cptr++ = '-';
+        }
+
+        do
+        {
+            digits[n++] = '0' + integer % 10;
+            integer /= 10;
+        } 
+        while ( integer > 0 );
+
+        while ( n > 0 )
+        {
+            *cptr++ = digits[--n];
+        }
+
+        *cptr++ = '.';
+
+        for ( i = 17; i >= 0; i-- )
+        {
+            cptr[i] = '0' + fraction % 10;
+            fraction /= 10;
+        }
+
+        cptr[18] = '\0';
+
+        return s;
+    }
+#endif
+
+    snprintf( s, MAX_VALUE_LEN, "%.18lf", value );
+
+    return s;
+}
+
+/* End of DemandValue API */
+
+
+/* Start of DemandInTime API */
+
+long
+getMinIntervalOfYear( Demand * d )
+{
+    // day is started at 1, hour at 0 and min interval at 0 from import data
+
+    return ( ( d->day - 1 ) * HOURS_IN_DAY + d->hh ) * MININTERVALS_IN_DAY + ( d->mm / MIN_IN_MININTERVAL );
+}
+
+
+/* the function sorts dptr by min interval of the year, tmp must have room for nrDemand
+ * pointers. Each pass is a counting sort on BITS_IN_RADIX bits of the min interval, 
+ * starting from the lowest bits, and the result is moved back to dptr when it ends up 
+ * in tmp.
+ */
+void
+sortDemandInTime( Demand * * dptr, Demand * * tmp, long nrDemand )
+{
+    long       count[NUM_RADIX];
+    Demand * * from = dptr;
+    Demand * * to = tmp;
+    Demand * * swap;
+    long       i;
+    long       sum;
+    long       n;
+    int        shift;
+
+
+    for ( shift = 0; ( MININTERVALS_IN_YEAR - 1 ) >> shift != 0; shift += BITS_IN_RADIX )
+    {
+        memset( count, 0, sizeof( count ) );
+
+        for ( i = 0; i < nrDemand; i++ )
+        {
+            count[( getMinIntervalOfYear( from[i] ) >> shift ) & ( NUM_RADIX - 1 )]++;
+        }
+
+        for ( sum = 0, i = 0; i < NUM_RADIX; i++ )
+        {
+            n = count[i];
+            count[i] = sum;
+            sum += n;
+        }
+
+        for ( i = 0; i < nrDemand; i++ )
+        {
+            to[count[( getMinIntervalOfYear( from[i] ) >> shift ) & ( NUM_RADIX - 1 )]++] = from[i];
+        }
+
+        swap = from;
+        from = to;
+        to = swap;
+    }
+
+    if ( from != dptr )
+    {
+        memcpy( dptr, from, nrDemand * sizeof( dptr[0] ) );
+    }
+}
+
+/* End of DemandInTime API */
+
+
+/* Start of DemandSketch API */
+
+/* the function returns the splitmix64 hash of key, its bits are all well mixed so that 
+ * any of them are used as a uniform random number of key.
+ */
+static uint64_t
+getSplitMixHash( uint64_t key )
+{
+    uint64_t z = key + 0x9e3779b97f4a7c15ULL;
+
+
+    z = ( z ^ ( z >> 30 ) ) * 0xbf58476d1ce4e5b9ULL;
+    z = ( z ^ ( z >> 27 ) ) * 0x94d049bb133111ebULL;
+
+    return z ^ ( z >> 31 );
+}
+
+
+DemandSketch *
+newDemandSketch( void )
+{
+    DemandSketch * sketch;
+
+
+    sketch = calloc( 1, sizeof( *sketch ) );
+    if ( NULL == sketch )
+    {
+        fprintf( stderr, "failed to allocate memory for DemandSketch\n" );
+        exit( 1 );
+    }
+
+    return sketch;
+}
+
+
+void
+deleteDemandSketch( DemandSketch * sketch )
+{
+    free( sketch->positive.cnt );
+    free( sketch->negative.cnt );
+    free( sketch->geohash6 );
+    free( sketch->rank );
+    free( sketch );
+}
+
+
+static double
+getGammaOfDemandSketch( void )
+{
+    return ( 1.0 + DEMAND_SKETCH_ACCURACY ) / ( 1.0 - DEMAND_SKETCH_ACCURACY );
+}
+
+
+/* the function adds cnt to bucket of store, the buckets are kept from the lowest to the 
+ * highest one that has a value, and the lowest of them are collapsed into one when there 
+ * are more than MAX_NUM_SKETCH_BIN, so the high values keep their accuracy.
+ */
+static void
+insertBucketInDemandSketchStore( DemandSketchStore * store, int bucket, long cnt )
+{
+    long * bin;
+    int    lo = bucket;
+    int    hi = bucket;
+    int    i;
+
+
+    if ( store->nrBin > 0 )
+    {
+        lo = ( store->offset < bucket ) ? store->offset : bucket;
+        hi = ( store->offset + store->nrBin - 1 > bucket ) ? store->offset + store->nrBin - 1 : bucket;
+    }
+
+    if ( hi - lo + 1 > MAX_NUM_SKETCH_BIN )
+    {
+        lo = hi - MAX_NUM_SKETCH_BIN + 1;
+    }
+
+    if ( 0 == store->nrBin
+         || lo != store->offset 
+         || hi - lo + 1 != store->nrBin )
+    {
+        bin = calloc( hi - lo + 1, sizeof( bin[0] ) );
+        if ( NULL == bin )
+        {
+            fprintf( stderr, "failed to allocate memory for DemandSketch\n" );
+            exit( 1 );
+        }
+
+        for ( i = 0; i < store->nrBin; i++ )
+        {
+            bin[( store->offset + i < lo ) ? 0 : store->offset + i - lo] += store->cnt[i];
+        }
+
+        free( store->cnt );
+        store->cnt = bin;
+        store->offset = lo;
+        store->nrBin = hi - lo + 1;
+    }
+
+    store->cnt[( bucket < lo ) ? 0 : bucket - lo] += cnt;
+}
+
+
+void
+insertValueInDemandSketch( DemandSketch * sketch, double value )
+{
+    int bucket;
+
+
+    // the bucket of inf is not an int, so inf, -inf and nan are counted apart
+
+    if ( isnan( value ) )
+    {
+        sketch->nrNan++;
+    }
+    else if ( isinf( value ) )
+    {
+        if ( value > 0.0 )
+        {
+            sketch->nrPositiveInf++;
+        }
+        else
+        {
+            sketch->nrNegativeInf++;
+        }
+    }
+    else if ( value > 0.0 )
+    {
+        bucket = ( int ) ceil( log( value ) / log( getGammaOfDemandSketch() ) );
+        insertBucketInDemandSketchStore( &( sketch->positive ), bucket, 1 );
+    }
+    else if ( value < 0.0 )
+    {
+        bucket = ( int ) ceil( log( -value ) / log( getGammaOfDemandSketch() ) );
+        insertBucketInDemandSketchStore( &( sketch->negative ), bucket, 1 );
+    }
+    else
+    {
+        sketch->nrZero++;
+    }
+}
+
+
+static void
+insertHashInDemandSketch( DemandSketch * sketch, uint64_t hash )
+{
+    uint8_t rank;
+    int     i;
+
+
+    // the register is picked by the high bits of hash, and keeps the most leading zeros 
+    // of the rest of them
+
+    i = hash >> ( BITS_IN_WORD - BITS_IN_SKETCH_REGISTER );
+    hash = ( hash << BITS_IN_SKETCH_REGISTER ) | ( ( uint64_t ) 1 << ( BITS_IN_SKETCH_REGISTER - 1 ) );
+    rank = __builtin_clzll( hash ) + 1;
+
+    if ( rank > sketch->rank[i] )
+    {
+        sketch->rank[i] = rank;
+    }
+}
+
+
+/* the function moves the listed geohash6 of sketch into the registers of HyperLogLog.
+ */
+static void
+newDemandSketchRegister( DemandSketch * sketch )
+{
+    int i;
+
+
+    sketch->rank = calloc( NUM_SKETCH_REGISTER, sizeof( sketch->rank[0] ) );
+    if ( NULL == sketch->rank )
+    {
+        fprintf( stderr, "failed to allocate memory for DemandSketch\n" );
+        exit( 1 );
+    }
+
+    for ( i = 0; i < sketch->nrGeohash6; i++ )
+    {
+        insertHashInDemandSketch( sketch, getSplitMixHash( sketch->geohash6[i] ) );
+    }
+
+    free( sketch->geohash6 );
+    sketch->geohash6 = NULL;
+    sketch->nrGeohash6 = 0;
+}
+
+
+/* the geohash6 values are listed until there are MAX_NUM_SKETCH_GEOHASH6 of them, then 
+ * they are moved into the registers of HyperLogLog.
+ */
+void
+insertGeohash6InDemandSketch( DemandSketch * sketch, uint32_t geohash6 )
+{
+    int i;
+
+
+    if ( NULL == sketch->rank )
+    {
+        for ( i = 0; i < sketch->nrGeohash6; i++ )
+        {
+            if ( sketch->geohash6[i] == geohash6 )
+            {
+                return;
+            }
+        }
+
+        if ( sketch->nrGeohash6 < MAX_NUM_SKETCH_GEOHASH6 )
+        {
+            if ( NULL == sketch->geohash6 )
+            {
+                sketch->geohash6 = malloc( MAX_NUM_SKETCH_GEOHASH6 * sizeof( sketch->geohash6[0] ) );
+                if ( NULL == sketch->geohash6 )
+                {
+                    fprintf( stderr, "failed to allocate memory for DemandSketch\n" );
+                    exit( 1 );
+                }
+            }
+
+            sketch->geohash6[sketch->nrGeohash6++] = geohash6;
+            return;
+        }
+
+        newDemandSketchRegister( sketch );
+    }
+
+    insertHashInDemandSketch( sketch, getSplitMixHash( geohash6 ) );
+}
+
+
+static void
+mergeDemandSketchStore( DemandSketchStore * store, DemandSketchStore * from )
+{
+    int i;
+
+
+    if ( 0 == from->nrBin )
+    {
+        return;
+    }
+
+    // the range of both is made first, so the buckets are copied once
+
+    insertBucketInDemandSketchStore( store, from->offset, 0 );
+    insertBucketInDemandSketchStore( store, from->offset + from->nrBin - 1, 0 );
+
+    for ( i = 0; i < from->nrBin; i++ )
+    {
+        if ( 0 != from->cnt[i] )
+        {
+            insertBucketInDemandSketchStore( store, from->offset + i, from->cnt[i] );
+        }
+    }
+}
+
+
+void
+mergeDemandSketch( DemandSketch * sketch, DemandSketch * from )
+{
+    int i;
+
+
+    mergeDemandSketchStore( &( sketch->positive ), &( from->positive ) );
+    mergeDemandSketchStore( &( sketch->negative ), &( from->negative ) );
+    sketch->nrPositiveInf += from->nrPositiveInf;
+    sketch->nrNegativeInf += from->nrNegativeInf;
+    sketch->nrNan += from->nrNan;
+    sketch->nrZero += from->nrZero;
+
+    if ( NULL == from->rank )
+    {
+        for ( i = 0; i < from->nrGeohash6; i++ )
+        {
+            insertGeohash6InDemandSketch( sketch, from->geohash6[i] );
+        }
+
+        return;
+    }
+
+    // a register of both keeps the most leading zeros of either
+
+    if ( NULL == sketch->rank )
+    {
+        newDemandSketchRegister( sketch );
+    }
+
+    for ( i = 0; i < NUM_SKETCH_REGISTER; i++ )
+    {
+        if ( from->rank[i] > sketch->rank[i] )
+        {
+            sketch->rank[i] = from->rank[i];
+        }
+    }
+}
+
+
+/* the function returns the value at rank q * ( n - 1 ) of the n values of sketch, which is 
+ * the middle of its bucket, -inf comes first, then the negative values from the highest bucket 
+ * of their absolute values, and inf comes last. It returns nan when there is no value or any 
+ * of them is nan.
+ */
+double
+getQuantileOfDemandSketch( DemandSketch * sketch, double q )
+{
+    double gamma = getGammaOfDemandSketch();
+    double rank;
+    long   nrValue = sketch->nrZero + sketch->nrPositiveInf + sketch->nrNegativeInf;
+    long   cnt = 0;
+    int    i;
+
+
+    for ( i = 0; i < sketch->positive.nrBin; i++ )
+    {
+        nrValue += sketch->positive.cnt[i];
+    }
+
+    for ( i = 0; i < sketch->negative.nrBin; i++ )
+    {
+        nrValue += sketch->negative.cnt[i];
+    }
+
+    if ( 0 == nrValue
+         || sketch->nrNan > 0 )
+    {
+        return NAN;
+    }
+
+    rank = q * ( nrValue - 1 );
+
+    cnt += sketch->nrNegativeInf;
+    if ( cnt > rank )
+    {
+        return -INFINITY;
+    }
+
+    for ( i = sketch->negative.nrBin - 1; i >= 0; i-- )
+    {
+        cnt += sketch->negative.cnt[i];
+        if ( cnt > rank )
+        {
+            return -2.0 * pow( gamma, sketch->negative.offset + i ) / ( gamma + 1.0 );
+        }
+    }
+
+    cnt += sketch->nrZero;
+    if ( cnt > rank )
+    {
+        return 0.0;
+    }
+
+    for ( i = 0; i < sketch->positive.nrBin; i++ )
+    {
+        cnt += sketch->positive.cnt[i];
+        if ( cnt > rank )
+        {
+            return 2.0 * pow( gamma, sketch->positive.offset + i ) / ( gamma + 1.0 );
+        }
+    }
+
+    if ( sketch->nrPositiveInf > 0 )
+    {
+        return INFINITY;
+    }
+
+    return 2.0 * pow( gamma, sketch->positive.offset + sketch->positive.nrBin - 1 ) / ( gamma + 1.0 );
+}
+
+
+/* the function returns the number of distinct geohash6 of sketch, the estimate of HyperLogLog 
+ * is replaced by linear counting of the empty registers when it is small.
+ */
+double
+getDistinctOfDemandSketch( DemandSketch * sketch )
+{
+    double sum = 0.0;
+    double estimate;
+    int    nrEmpty = 0;
+    int    i;
+
+
+    if ( NULL == sketch->rank )
+    {
+        return sketch->nrGeohash6;
+    }
+
+    for ( i = 0; i < NUM_SKETCH_REGISTER; i++ )
+    {
+        sum += ldexp( 1.0, -sketch->rank[i] );
+        nrEmpty += ( 0 == sketch->rank[i] );
+    }
+
+    estimate = 0.7213 / ( 1.0 + 1.079 / NUM_SKETCH_REGISTER ) * NUM_SKETCH_REGISTER * NUM_SKETCH_REGISTER / sum;
+
+    if ( estimate <= 2.5 * NUM_SKETCH_REGISTER
+         && nrEmpty > 0 )
+    {
+        estimate = NUM_SKETCH_REGISTER * log( ( double ) NUM_SKETCH_REGISTER / nrEmpty );
+    }
+
+    return round( estimate );
+}
+
+/* End of DemandSketch API */
+
+
+/* Start of DemandAggregate API */
+
+int
+parseAggregate( char * s, int * aggregate )
+{
+    static char * names[NUM_AGGREGATE] = { "count", "sum", "mean", "min", "max", "stddev", "p50", "p90", "p99", "distinct" };
+    char        * tok;
+    char        * save;
+    int           nrAggregate = 0;
+    int           i;
+
+
+    for ( tok = strtok_r( s, ",", &save ); NULL != tok; tok = strtok_r( NULL, ",", &save ) )
+    {
+        for ( i = 0; i < NUM_AGGREGATE; i++ )
+        {
+            if ( strcmp( tok, names[i] ) == 0 )
+            {
+                break;
+            }
+        }
+
+        if ( i >= NUM_AGGREGATE 
+             || nrAggregate >= NUM_AGGREGATE )
+        {
+            return -1;
+        }
+
+        aggregate[nrAggregate++] = i;
+    }
+
+    return nrAggregate;
+}
+
+
+int
+parseGroupBy( char * s )
+{
+    char * tok;
+    char * save;
+    int    groupBy = 0;
+
+
+    for ( tok = strtok_r( s, ",", &save ); NULL != tok; tok = strtok_r( NULL, ",", &save ) )
+    {
+        if ( strcmp( tok, "geohash" ) == 0 
+             || strcmp( tok, "geohash6" ) == 0 )
+        {
+            groupBy |= GROUP_BY_GEOHASH6;
+        }
+        else if ( strcmp( tok, "day" ) == 0 )
+        {
+            groupBy |= GROUP_BY_DAY;
+        }
+        else if ( strcmp( tok, "hour" ) == 0 )
+        {
+            groupBy |= GROUP_BY_HOUR;
+        }
+        else if ( strcmp( tok, "interval" ) == 0 )
+        {
+            groupBy |= GROUP_BY_MININTERVAL;
+        }
+        else
+        {
+            return -1;
+        }
+    }
+
+    // hour and 15 minutes interval are the same key in different granularity
+
+    if ( ( groupBy & GROUP_BY_HOUR )
+         && ( groupBy & GROUP_BY_MININTERVAL ) )
+    {
+        return -1;
+    }
+
+    return groupBy;
+}
+
+
+DemandAggregate *
+newDemandAggregate( int groupBy, int * aggregate, int nrAggregate )
+{
+    DemandAggregate * agg;
+    int               i;
+
+
+    agg = malloc( sizeof( *agg ) );
+    if ( NULL == agg )
+    {
+        fprintf( stderr, "failed to allocate memory for DemandAggregate\n" );
+        exit( 1 );
+    }
+
+    agg->groupBy = groupBy;
+    agg->nrAggregate = nrAggregate;
+    agg->isQuantile = 0;
+    agg->isDistinct = 0;
+    agg->scale = 1.0;
+    for ( i = 0; i < nrAggregate; i++ )
+    {
+        agg->aggregate[i] = aggregate[i];
+        agg->isQuantile |= ( AGGREGATE_P50 == aggregate[i] || AGGREGATE_P90 == aggregate[i] || AGGREGATE_P99 == aggregate[i] );
+        agg->isDistinct |= ( AGGREGATE_DISTINCT == aggregate[i] );
+    }
+
+    agg->nrGroup = 0;
+    agg->nrBucket = NUM_HASH_SIZE;
+    agg->bucket = calloc( agg->nrBucket, sizeof( DemandInGroup * ) );
+    if ( NULL == agg->bucket )
+    {
+        fprintf( stderr, "failed to allocate memory for more DemandInGroup *\n" );
+        exit( 1 );
+    }
+
+    return agg;
+}
+
+
+void
+deleteDemandAggregate( DemandAggregate * agg )
+{
+    long            i;
+    DemandInGroup * group;
+    DemandInGroup * next;
+
+
+    for ( i = 0; i < agg->nrBucket; i++ )
+    {
+        for ( group = agg->bucket[i]; NULL != group; group = next )
+        {
+            next = group->next;
+
+            if ( NULL != group->sketch )
+            {
+                deleteDemandSketch( group->sketch );
+            }
+
+            free( group );
+        }
+    }
+
+    free( agg->bucket );
+    free( agg );
+}
+
+
+static unsigned long
+getHashValueOfGroupKey( Demand * key )
+{
+    unsigned long result;
+
+
+    result = key->geohash6;
+    result = result * HASH_MULTIPLIER + key->day;
+    result = result * HASH_MULTIPLIER + key->hh;
+    result = result * HASH_MULTIPLIER + key->mm;
+
+    return result;
+}
+
+
+/* the hash structure is doubled when it has more groups than buckets, so a chain stays 
+ * short even when demands are grouped by geohash6, day and interval.
+ */
+static void
+growDemandAggregate( DemandAggregate * agg )
+{
+    DemandInGroup * * bucket;
+    DemandInGroup   * group;
+    DemandInGroup   * next;
+    long              nrBucket;
+    long              hashkey;
+    long              i;
+
+
+    nrBucket = agg->nrBucket * 2;
+    bucket = calloc( nrBucket, sizeof( DemandInGroup * ) );
+    if ( NULL == bucket )
+    {
+        fprintf( stderr, "failed to allocate memory for more DemandInGroup *\n" );
+        exit( 1 );
+    }
+
+    for ( i = 0; i < agg->nrBucket; i++ )
+    {
+        for ( group = agg->bucket[i]; NULL != group; group = next )
+        {
+            next = group->next;
+
+            hashkey = getHashValueOfGroupKey( &( group->key ) ) % nrBucket;
+            group->next = bucket[hashkey];
+            bucket[hashkey] = group;
+        }
+    }
+
+    free( agg->bucket );
+    agg->bucket = bucket;
+    agg->nrBucket = nrBucket;
+}
+
+
+DemandInGroup *
+insertGroupInAggregate( DemandAggregate * agg, Demand * d )
+{
+    Demand          key = { 0, 0, 0, 0, 0.0 };
+    DemandInGroup * group;
+    long            hashkey;
+
+
+    if ( agg->groupBy & GROUP_BY_GEOHASH6 )
+    {
+        key.geohash6 = d->geohash6;
+    }
+
+    if ( agg->groupBy & GROUP_BY_DAY )
+    {
+        key.day = d->day;
+    }
+
+    if ( agg->groupBy & ( GROUP_BY_HOUR | GROUP_BY_MININTERVAL ) )
+    {
+        key.hh = d->hh;
+    }
+
+    if ( agg->groupBy & GROUP_BY_MININTERVAL )
+    {
+        key.mm = d->mm - ( d->mm % MIN_IN_MININTERVAL );
+    }
+
+    hashkey = getHashValueOfGroupKey( &key ) % agg->nrBucket;
+
+    for ( group = agg->bucket[hashkey]; NULL != group; group = group->next )
+    {
+        if ( group->key.day == key.day
+             && group->key.hh == key.hh
+             && group->key.mm == key.mm
+             && group->key.geohash6 == key.geohash6 )
+        {
+            break;
+        }
+    }
+
+    if ( NULL == group )
+    {
+        if ( agg->nrGroup >= agg->nrBucket )
+        {
+            growDemandAggregate( agg );
+
+            hashkey = getHashValueOfGroupKey( &key ) % agg->nrBucket;
+        }
+
+        group = malloc( sizeof( *group ) );
+        if ( NULL == group )
+        {
+            fprintf( stderr, "failed to allocate memory for more DemandInGroup\n" );
+            exit( 1 );
+        }
+
+        group->key = key;
+        group->cnt = 0;
+        group->sum = 0.0;
+        group->min = d->value;
+        group->max = d->value;
+        group->mean = 0.0;
+        group->m2 = 0.0;
+        group->sketch = ( agg->isQuantile || agg->isDistinct ) ? newDemandSketch() : NULL;
+
+        group->next = agg->bucket[hashkey];
+        agg->bucket[hashkey] = group;
+        agg->nrGroup++;
+    }
+
+    return group;
+}
+
+
+DemandInGroup *
+insertDemandInAggregate( DemandAggregate * agg, Demand * d )
+{
+    DemandInGroup * group;
+    double          delta;
+
+
+    group = insertGroupInAggregate( agg, d );
+
+    group->cnt++;
+    group->sum += d->value;
+
+    if ( d->value < group->min )
+    {
+        group->min = d->value;
+    }
+
+    if ( d->value > group->max )
+    {
+        group->max = d->value;
+    }
+
+    delta = d->value - group->mean;
+    group->mean += delta / group->cnt;
+    group->m2 += delta * ( d->value - group->mean );
+
+    if ( agg->isQuantile )
+    {
+        insertValueInDemandSketch( group->sketch, d->value );
+    }
+
+    if ( agg->isDistinct )
+    {
+        insertGeohash6InDemandSketch( group->sketch, d->geohash6 );
+    }
+
+    return group;
+}
+
+
+/* the function adds count and sum of demands that are summarized elsewhere into the group 
+ * of d, so only count, sum and mean of the group are valid afterward.
+ */
+DemandInGroup *
+mergeDemandInAggregate( DemandAggregate * agg, Demand * d, long cnt, double sum )
+{
+    DemandInGroup * group;
+
+
+    group = insertGroupInAggregate( agg, d );
+
+    group->cnt += cnt;
+    group->sum += sum;
+
+    return group;
+}
+
+
+/* the function merges the groups of from into agg, both have the same group by and 
+ * aggregates. The mean and sum of squared differences of two groups are combined by 
+ * the parallel form of Welford's method.
+ */
+void
+mergeDemandAggregate( DemandAggregate * agg, DemandAggregate * from )
+{
+    DemandInGroup * group;
+    DemandInGroup * fromGroup;
+    Demand          d;
+    double          delta;
+    long            cnt;
+    long            i;
+
+
+    for ( i = 0; i < from->nrBucket; i++ )
+    {
+        for ( fromGroup = from->bucket[i]; NULL != fromGroup; fromGroup = fromGroup->next )
+        {
+            if ( 0 == fromGroup->cnt )
+            {
+                continue;
+            }
+
+            d = fromGroup->key;
+            d.value = fromGroup->min;
+            group = insertGroupInAggregate( agg, &d );
+
+            cnt = group->cnt + fromGroup->cnt;
+            delta = fromGroup->mean - group->mean;
+            group->mean += delta * fromGroup->cnt / cnt;
+            group->m2 += fromGroup->m2 + delta * delta * group->cnt * fromGroup->cnt / cnt;
+            group->cnt = cnt;
+            group->sum += fromGroup->sum;
+
+            if ( fromGroup->min < group->min )
+            {
+                group->min = fromGroup->min;
+            }
+
+            if ( fromGroup->max > group->max )
+            {
+                group->max = fromGroup->max;
+            }
+
+            if ( NULL != fromGroup->sketch )
+            {
+                mergeDemandSketch( group->sketch, fromGroup->sketch );
+            }
+        }
+    }
+}
+
+
+void
+printDemandInGroup( FILE * out, DemandAggregate * agg, DemandInGroup * group )
+{
+    int    i;
+    int    isFirst = 1;
+    char   geohash6[GEOHASH6_LEN + 1];
+    char   value[MAX_VALUE_LEN];
+    double result;
+
+
+    if ( agg->groupBy & GROUP_BY_GEOHASH6 )
+    {
+        fprintf( out, "%s", decodeGeohash6( group->key.geohash6, geohash6 ) );
+        isFirst = 0;
+    }
+
+    if ( agg->groupBy & GROUP_BY_DAY )
+    {
+        fprintf( out, isFirst ? "%02d" : ",%02d", group->key.day );
+        isFirst = 0;
+    }
+
+    if ( agg->groupBy & ( GROUP_BY_HOUR | GROUP_BY_MININTERVAL ) )
+    {
+        fprintf( out, isFirst ? "%02d:%02d" : ",%02d:%02d", group->key.hh, group->key.mm );
+        isFirst = 0;
+    }
+
+    for ( i = 0; i < agg->nrAggregate; i++ )
+    {
+        if ( ! isFirst )
+        {
+            fprintf( out, "," );
+        }
+
+        isFirst = 0;
+
+        result = getValueOfDemandInGroup( agg, group, agg->aggregate[i] );
+
+        // mean, min, max, stddev and quantiles are not defined for no demand, any other 
+        // nan is from the values, like inf and -inf, and is printed with its sign
+
+        if ( 0 == group->cnt
+             && isnan( result ) )
+        {
+            fprintf( out, "nan" );
+        }
+        else if ( AGGREGATE_COUNT == agg->aggregate[i]
+                  || AGGREGATE_DISTINCT == agg->aggregate[i] )
+        {
+            fprintf( out, "%ld", ( long ) result );
+        }
+        else
+        {
+            fputs( formatDemandValue( result, value ), out );
+        }
+    }
+
+    fprintf( out, "\n" );
+}
+
+
+static int
+compareDemandInGroup( const void * a, const void * b )
+{
+    const DemandInGroup * ga = *( DemandInGroup * const * ) a;
+    const DemandInGroup * gb = *( DemandInGroup * const * ) b;
+    int                   ret;
+
+
+    if ( ga->key.geohash6 != gb->key.geohash6 )
+    {
+        ret = ( ga->key.geohash6 < gb->key.geohash6 ) ? -1 : 1;
+    }
+    else
+    {
+        ret = ( ga->key.day * HOURS_IN_DAY + ga->key.hh ) * MINS_IN_HOUR + ga->key.mm
+              - ( ( gb->key.day * HOURS_IN_DAY + gb->key.hh ) * MINS_IN_HOUR + gb->key.mm );
+    }
+
+    return ret;
+}
+
+
+/* the function calls function for each group of agg in the order of geohash6, day and 
+ * time, and once for an empty group when demands are not grouped and there is none.
+ */
+void
+forEachDemandInGroup( DemandAggregate * agg, DemandInGroupFunction function, void * arg )
+{
+    DemandInGroup * * list;
+    DemandInGroup   * group;
+    long              nrGroup = 0;
+    long              i;
+
+
+    // there is always a line for the aggregates when demands are not grouped, like awk
+
+    if ( 0 == agg->groupBy 
+         && 0 == agg->nrGroup )
+    {
+        DemandInGroup empty = { NULL, { 0, 0, 0, 0, 0.0 }, 0, 0.0, 0.0, 0.0, 0.0, 0.0, NULL };
+
+        function( agg, &empty, arg );
+        return;
+    }
+
+    list = malloc( ( agg->nrGroup + 1 ) * sizeof( DemandInGroup * ) );
+    if ( NULL == list )
+    {
+        fprintf( stderr, "failed to allocate memory for more DemandInGroup *\n" );
+        exit( 1 );
+    }
+
+    for ( i = 0; i < agg->nrBucket; i++ )
+    {
+        for ( group = agg->bucket[i]; NULL != group; group = group->next )
+        {
+            list[nrGroup++] = group;
+        }
+    }
+
+    qsort( list, nrGroup, sizeof( list[0] ), compareDemandInGroup );
+
+    for ( i = 0; i < nrGroup; i++ )
+    {
+        function( agg, list[i], arg );
+    }
+
+    free( list );
+}
+
+
+static void
+printDemandInGroupToStream( DemandAggregate * agg, DemandInGroup * group, void * arg )
+{
+    printDemandInGroup( arg, agg, group );
+}
+
+
+void
+printDemandAggregate( FILE * out, DemandAggregate * agg )
+{
+    forEachDemandInGroup( agg, printDemandInGroupToStream, out );
+}
+
+
+/* the function returns the aggregate of group, which is nan for no demand except count, 
+ * sum and distinct. Count and sum are estimated from sampled demands by the scale of agg, 
+ * and a quantile is kept within min and max of the group.
+ */
+double
+getValueOfDemandInGroup( DemandAggregate * agg, DemandInGroup * group, int aggregate )
+{
+    double q = 0.0;
+    double value;
+
+
+    if ( 0 == group->cnt
+         && AGGREGATE_COUNT != aggregate
+         && AGGREGATE_SUM != aggregate
+         && AGGREGATE_DISTINCT != aggregate )
+    {
+        return NAN;
+    }
+
+    switch ( aggregate )
+    {
+        case AGGREGATE_COUNT:
+            return ( 1.0 == agg->scale ) ? group->cnt : round( group->cnt * agg->scale );
+
+        case AGGREGATE_SUM:
+            return group->sum * agg->scale;
+
+        case AGGREGATE_MEAN:
+            return group->sum / group->cnt;
+
+        case AGGREGATE_MIN:
+            return group->min;
+
+        case AGGREGATE_MAX:
+            return group->max;
+
+        case AGGREGATE_STDDEV:
+            return sqrt( group->m2 / group->cnt );
+
+        case AGGREGATE_P50:
+        case AGGREGATE_P90:
+        case AGGREGATE_P99:
+            q = ( AGGREGATE_P50 == aggregate ) ? 0.5 : ( AGGREGATE_P90 == aggregate ) ? 0.9 : 0.99;
+            value = getQuantileOfDemandSketch( group->sketch, q );
+            value = ( value < group->min ) ? group->min : value;
+            value = ( value > group->max ) ? group->max : value;
+            return value;
+
+        case AGGREGATE_DISTINCT:
+            return ( NULL == group->sketch ) ? 0.0 : getDistinctOfDemandSketch( group->sketch );
+    }
+
+    return NAN;
+}
+
+
+typedef struct demandingrouprank DemandInGroupRank;
+
+struct demandingrouprank
+{
+    DemandInGroup * group;
+    double          value;
+};
+
+
+/* the function returns more than 0 when a ranks before b, by larger value and then by 
+ * the order of groups printed by printDemandAggregate.
+ */
+static int
+isDemandInGroupRankBefore( DemandInGroupRank * a, DemandInGroupRank * b )
+{
+    if ( a->value != b->value )
+    {
+        return a->value > b->value;
+    }
+
+    return compareDemandInGroup( &( a->group ), &( b->group ) ) < 0;
+}
+
+
+static int
+compareDemandInGroupRank( const void * a, const void * b )
+{
+    DemandInGroupRank * ra = ( DemandInGroupRank * ) a;
+    DemandInGroupRank * rb = ( DemandInGroupRank * ) b;
+
+
+    return isDemandInGroupRankBefore( ra, rb ) ? -1 : isDemandInGroupRankBefore( rb, ra );
+}
+
+
+/* the function moves down heap[i] of a heap with the lowest ranked group at its root.
+ */
+static void
+siftDemandInGroupRank( DemandInGroupRank * heap, long nrHeap, long i )
+{
+    DemandInGroupRank tmp;
+    long              child;
+
+
+    while ( ( child = 2 * i + 1 ) < nrHeap )
+    {
+        if ( child + 1 < nrHeap
+             && isDemandInGroupRankBefore( &heap[child], &heap[child + 1] ) )
+        {
+            child++;
+        }
+
+        if ( ! isDemandInGroupRankBefore( &heap[i], &heap[child] ) )
+        {
+            break;
+        }
+
+        tmp = heap[i];
+        heap[i] = heap[child];
+        heap[child] = tmp;
+        i = child;
+    }
+}
+
+
+/* the function prints the nrTop groups with the largest first aggregate in descending order 
+ * of it, groups without a value (nan) are not ranked. The heap keeps the top groups so far 
+ * with the lowest of them at its root, so a group replaces the root when it ranks before it.
+ */
+void
+printTopOfDemandAggregate( FILE * out, DemandAggregate * agg, long nrTop )
+{
+    DemandInGroupRank * heap;
+    DemandInGroupRank   rank;
+    DemandInGroup     * group;
+    long                nrHeap = 0;
+    long                i;
+
+
+    // the line of the empty group is printed when demands are not grouped and there 
+    // is none, like without --top
+
+    if ( 0 == agg->groupBy 
+         && 0 == agg->nrGroup )
+    {
+        printDemandAggregate( out, agg );
+        return;
+    }
+
+    nrTop = ( nrTop > agg->nrGroup ) ? agg->nrGroup : nrTop;
+
+    heap = malloc( ( nrTop + 1 ) * sizeof( heap[0] ) );
+    if ( NULL == heap )
+    {
+        fprintf( stderr, "failed to allocate memory for top groups\n" );
+        exit( 1 );
+    }
+
+    for ( i = 0; i < agg->nrBucket; i++ )
+    {
+        for ( group = agg->bucket[i]; NULL != group; group = group->next )
+        {
+            rank.group = group;
+            rank.value = getValueOfDemandInGroup( agg, group, agg->aggregate[0] );
+
+            if ( isnan( rank.value ) )
+            {
+                continue;
+            }
+
+            if ( nrHeap < nrTop )
+            {
+                long j;
+
+
+                // the new group moves up until its parent ranks after it
+
+                for ( j = nrHeap++; j > 0 && isDemandInGroupRankBefore( &heap[( j - 1 ) / 2], &rank ); j = ( j - 1 ) / 2 )
+                {
+                    heap[j] = heap[( j - 1 ) / 2];
+                }
+
+                heap[j] = rank;
+            }
+            else if ( nrHeap > 0
+                      && isDemandInGroupRankBefore( &rank, &heap[0] ) )
+            {
+                heap[0] = rank;
+                siftDemandInGroupRank( heap, nrHeap, 0 );
+            }
+        }
+    }
+
+    qsort( heap, nrHeap, sizeof( heap[0] ), compareDemandInGroupRank );
+
+    for ( i = 0; i < nrHeap; i++ )
+    {
+        printDemandInGroup( out, agg, heap[i].group );
+    }
+
+    free( heap );
+}
+
+
+long
+getLongestChainOfDemandAggregate( DemandAggregate * agg )
+{
+    DemandInGroup * group;
+    long            i;
+    long            chain;
+    long            longestChain = 0;
+
+
+    for ( i = 0; i < agg->nrBucket; i++ )
+    {
+        chain = 0;
+        for ( group = agg->bucket[i]; NULL != group; group = group->next )
+        {
+            chain++;
+        }
+
+        if ( chain > longestChain )
+        {
+            longestChain = chain;
+        }
+    }
+
+    return longestChain;
+}
+
+/* End of DemandAggregate API */
+
+
+Demand *
+scanDemand( char * cptr, Demand * dptr )
+{
+    int    c;
+    int    inMm        = 0;
+    int    index       = 0;
+    int    geohash6Len = 0;
+    int    hasValue    = 0;
+    int    value;
+    Demand d           = { 0, 0, 0, 0, 0.0 };
+
+
+    while ( ( c = *cptr++ ) != '\0'
+            && c != '\n' )
+    {
+        if ( ',' == c )
+        {
+            if ( 0 == index )
+            {
+                if ( geohash6Len != GEOHASH6_LEN )
+                {
+                    return NULL;
+                }
+            }
+            else if ( 2 == index )
+            {
+                parseDemandValue( cptr, &( d.value ) );
+                hasValue = 1;
+                break;
+            }
+
+            index++;
+        }
+        else
+        {
+            switch ( index )
+            {
+                case 0:
+                    if ( geohash6Len < GEOHASH6_LEN
+                         && ( value = getValueOfGeohashChar( c ) ) >= 0 )
+                    {
+                        d.geohash6 = ( d.geohash6 << BITS_IN_GEOHASH_CHAR ) | value;
+                        geohash6Len++;
+                    }
+                    else
+                    {
+                        return NULL;
+                    }
+
+                    break;
+
+                case 1:
+                    if ( !isdigit( c ) )
+                    {
+                        return NULL;                      
+                    }
+
+                    d.day = d.day * 10 + ( c - '0' );
+                    break;
+
+                case 2:
+                    if ( c == ':' )
+                    {
+                        inMm = 1;
+                    }
+                    else 
+                    {
+                        if ( !isdigit( c ) )
+                        {
+                            return NULL;                      
+                        }
+
+                        if ( inMm )
+                        {
+                            d.mm = d.mm * 10 + ( c - '0' );
+                        }
+                        else
+                        {
+                            d.hh = d.hh * 10 + ( c - '0' );
+                        }
+                    }
+
+                    break;
+            } // switch        
+        } // else not yet reach ','
+    } // while not end of line
+
+    // reject incomplete line (like the header) or timestamp that is out of 
+    // the range of a year
+
+    if ( ! hasValue
+         || d.day <= 0
+         || d.day > DAYS_IN_YEAR
+         || d.hh >= HOURS_IN_DAY
+         || d.mm >= MINS_IN_HOUR )
+    {
+        return NULL;
+    }
+
+    *dptr = d;
+
+    return dptr;
+}
+
+
+/* the function writes day, hour or minute with at least 2 digits into s and returns 
+ * the end, value must be 0 to 999.
+ */
+static char *
+formatDemandNumber( int value, char * s )
+{
+    if ( value >= 100 )
+    {
+        *s++ = '0' + value / 100;
+    }
+
+    *s++ = '0' + value / 10 % 10;
+    *s++ = '0' + value % 10;
+
+    return s;
+}
+
+
+void
+printDemand( FILE * out, Demand * d )
+{
+    char   line[GEOHASH6_LEN + MAX_VALUE_LEN + 16];
+    char * cptr = line;
+
+
+    // same as printf( "%s,%02d,%02d:%02d,%.18lf\n" ) 
+
+    decodeGeohash6( d->geohash6, cptr );
+    cptr += GEOHASH6_LEN;
+    *cptr++ = ',';
+    cptr = formatDemandNumber( d->day, cptr );
+    *cptr++ = ',';
+    cptr = formatDemandNumber( d->hh, cptr );
+    *cptr++ = ':';
+    cptr = formatDemandNumber( d->mm, cptr );
+    *cptr++ = ',';
+    formatDemandValue( d->value, cptr );
+    cptr += strlen( cptr );
+    *cptr++ = '\n';
+
+    fwrite( line, 1, cptr - line, out );
+}
+
+
+int
+isDemandInTimeFilter( DemandFilter * filter, Demand * d )
+{
+    long minInterval = getMinIntervalOfYear( d );
+
+
+    return filter->minInterval[minInterval / BITS_IN_WORD] >> ( minInterval % BITS_IN_WORD ) & 1;
+}
+
+
+/* the function returns 1 when the hash of the fields of d is not more than the sample 
+ * threshold of filter, which is UINT64_MAX when demands are not sampled.
+ */
+int
+isDemandSampled( DemandFilter * filter, Demand * d )
+{
+    uint64_t key;
+    uint64_t value;
+
+
+    if ( UINT64_MAX == filter->sampleThreshold )
+    {
+        return 1;
+    }
+
+    memcpy( &value, &( d->value ), sizeof( value ) );
+    key = ( ( ( uint64_t ) d->day * HOURS_IN_DAY + d->hh ) * MINS_IN_HOUR + d->mm ) << 32 | d->geohash6;
+
+    return getSplitMixHash( getSplitMixHash( key ) ^ value ) <= filter->sampleThreshold;
+}
+
+
+int
+isDemandInFilter( DemandFilter * filter, Demand * d )
+{
+    if ( ! isDemandInTimeFilter( filter, d ) 
+         || ! isGeohash6InFilter( filter, d->geohash6 ) )
+    {
+        return 0;
+    }
+
+    return isDemandSampled( filter, d );
+}
+
+
+void
+appendDemand( DemandBuffer * buf, Demand * d )
+{
+    Demand * dptr;
+
+
+    if ( buf->nrDemand >= buf->maxDemand )
+    {
+        buf->maxDemand = ( 0 == buf->maxDemand ) ? NUM_DEMAND_PER_NODE : buf->maxDemand * 2;
+
+        dptr = realloc( buf->d, buf->maxDemand * sizeof ( buf->d[0] ) );
+        if ( dptr == NULL )
+        {
+            fprintf( stderr, "no memory\n" );
+            exit( 1 );
+        }
+
+        buf->d = dptr;              
+    }
+
+    buf->d[buf->nrDemand++] = *d;
+}
+
+
+void
+processDemandInQuery( DemandQuery * query, Demand * d )
+{
+    query->stats.nrMatched++;
+
+    if ( NULL != query->agg )
+    {
+        insertDemandInAggregate( query->agg, d );
+    }
+    else if ( query->isUnordered )
+    {
+        printDemand( stdout, d );
+    }
+    else
+    {
+        appendDemand( &( query->result ), d );
+    }
+}
+
+
+/* Start of demand input API */
+
+void
+readDemandFromStream( DemandQuery * query, FILE * file )
+{
+    char   buf[BUFSIZ];
+    Demand d;
+
+
+    while ( fgets( buf, sizeof buf, file ) != NULL )
+    {
+        query->stats.nrRead++;
+
+        if ( NULL == scanDemand( buf, &d ) )
+        {
+            query->stats.nrRejected++;
+        }
+        else if ( isDemandInFilter( &( query->filter ), &d ) )
+        {
+            processDemandInQuery( query, &d );
+        }
+    }
+}
+
+
+/* the function returns the compression of a file starting with len bytes at s, only the 
+ * first byte is looked at when len is 1, which is all that is known of a stream.
+ */
+int
+getDemandCompression( unsigned char * s, size_t len )
+{
+    static const unsigned char gzipMagic[] = { 0x1f, 0x8b };
+    static const unsigned char zstdMagic[] = { 0x28, 0xb5, 0x2f, 0xfd };
+
+
+    if ( len > 0
+         && memcmp( s, gzipMagic, ( len < sizeof( gzipMagic ) ) ? len : sizeof( gzipMagic ) ) == 0 )
+    {
+        return COMPRESSION_GZIP;
+    }
+
+    if ( len > 0
+         && memcmp( s, zstdMagic, ( len < sizeof( zstdMagic ) ) ? len : sizeof( zstdMagic ) ) == 0 )
+    {
+        return COMPRESSION_ZSTD;
+    }
+
+    return COMPRESSION_NONE;
+}
+
+
+typedef struct demanddecompressor DemandDecompressor;
+
+struct demanddecompressor
+{
+    FILE            * file;
+    int               compression;
+    char            * buf[NUM_DECOMPRESSED_BUFFER];  // whole lines ended by '\0'
+    size_t            len[NUM_DECOMPRESSED_BUFFER];
+    long              nrFilled;    // buffers filled by the decompressing thread
+    long              nrScanned;   // buffers scanned, buf[i % NUM_DECOMPRESSED_BUFFER] is free after it
+    int               isEnd;       // no buffer is filled after nrFilled
+    pthread_mutex_t   mutex;
+    pthread_cond_t    cond;
+    unsigned char     in[BUFSIZ * 16];
+    size_t            nrIn;
+    size_t            posIn;
+    char            * out;         // decompressed bytes are written to out up to nrOut bytes
+    size_t            nrOut;
+    char              err[MAX_ERROR_LEN];  // the file ends at an error, err is empty without one
+#ifdef HAVE_ZLIB
+    z_stream          gzip;
+    int               isGzipEnd;   // end of a gzip member
+#endif
+#ifdef HAVE_ZSTD
+    ZSTD_DCtx       * zstd;
+    size_t            zstdRet;     // 0 at the end of a zstd frame
+#endif
+};
+
+
+#if defined( HAVE_ZLIB ) || defined( HAVE_ZSTD )
+
+/* the function reads the next compressed bytes into dec->in, and returns 0 at the end of file.
+ */
+static int
+readCompressedDemand( DemandDecompressor * dec )
+{
+    dec->nrIn = fread( dec->in, 1, sizeof( dec->in ), dec->file );
+    dec->posIn = 0;
+
+    if ( ferror( dec->file ) )
+    {
+        snprintf( dec->err, MAX_ERROR_LEN, "failed to read compressed file: %s", strerror( errno ) );
+        return 0;
+    }
+
+    return dec->nrIn > 0;
+}
+
+#endif
+
+
+/* the function decompresses up to dec->nrOut bytes into dec->out, and returns the number 
+ * of bytes, 0 at the end of file or at an error in dec->err. A file of several gzip members 
+ * or zstd frames is read as one.
+ */
+static size_t
+decompressDemand( DemandDecompressor * dec )
+{
+    size_t n = 0;
+
+
+    switch ( dec->compression )
+    {
+#ifdef HAVE_ZLIB
+        case COMPRESSION_GZIP:
+        {
+            int ret;
+
+
+            while ( 0 == n )
+            {
+                if ( dec->posIn >= dec->nrIn
+                     && ! readCompressedDemand( dec ) )
+                {
+                    if ( ! dec->isGzipEnd 
+                         && '\0' == dec->err[0] )
+                    {
+                        snprintf( dec->err, MAX_ERROR_LEN, "gzip file is truncated" );
+                    }
+
+                    break;
+                }
+
+                if ( dec->isGzipEnd )
+                {
+                    inflateReset( &( dec->gzip ) );
+                    dec->isGzipEnd = 0;
+                }
+
+                dec->gzip.next_in = dec->in + dec->posIn;
+                dec->gzip.avail_in = dec->nrIn - dec->posIn;
+                dec->gzip.next_out = ( unsigned char * ) dec->out;
+                dec->gzip.avail_out = dec->nrOut;
+
+                ret = inflate( &( dec->gzip ), Z_NO_FLUSH );
+                if ( Z_STREAM_END == ret )
+                {
+                    dec->isGzipEnd = 1;
+                }
+                else if ( Z_OK != ret
+                          && Z_BUF_ERROR != ret )
+                {
+                    snprintf( dec->err, MAX_ERROR_LEN, "failed to decompress gzip file: %s", ( NULL != dec->gzip.msg ) ? dec->gzip.msg : zError( ret ) );
+                    break;
+                }
+
+                dec->posIn = dec->nrIn - dec->gzip.avail_in;
+                n = dec->nrOut - dec->gzip.avail_out;
+            }
+
+            break;
+        }
+#endif
+
+#ifdef HAVE_ZSTD
+        case COMPRESSION_ZSTD:
+        {
+            ZSTD_inBuffer  zin;
+            ZSTD_outBuffer zout;
+
+
+            while ( 0 == n )
+            {
+                if ( dec->posIn >= dec->nrIn
+                     && ! readCompressedDemand( dec ) )
+                {
+                    // the last frame may still have decompressed bytes without more input
+
+                    if ( 0 == dec->zstdRet 
+                         || '\0' != dec->err[0] )
+                    {
+                        break;
+                    }
+                }
+
+                zin.src = dec->in;
+                zin.size = dec->nrIn;
+                zin.pos = dec->posIn;
+                zout.dst = dec->out;
+                zout.size = dec->nrOut;
+                zout.pos = 0;
+
+                dec->zstdRet = ZSTD_decompressStream( dec->zstd, &zout, &zin );
+                if ( ZSTD_isError( dec->zstdRet ) )
+                {
+                    snprintf( dec->err, MAX_ERROR_LEN, "failed to decompress zstd file: %s", ZSTD_getErrorName( dec->zstdRet ) );
+                    break;
+                }
+
+                dec->posIn = zin.pos;
+                n = zout.pos;
+
+                if ( 0 == n
+                     && dec->posIn >= dec->nrIn
+                     && feof( dec->file ) )
+                {
+                    snprintf( dec->err, MAX_ERROR_LEN, "zstd file is truncated" );
+                    break;
+                }
+            }
+
+            break;
+        }
+#endif
+
+        default:
+            snprintf( dec->err, MAX_ERROR_LEN, "%s input is not supported by this build, it needs -D%s",
+                      ( COMPRESSION_GZIP == dec->compression ) ? "gzip" : "zstd", 
+                      ( COMPRESSION_GZIP == dec->compression ) ? "HAVE_ZLIB -lz" : "HAVE_ZSTD -lzstd" );
+            break;
+    }
+
+    return n;
+}
+
+
+/* the function is the decompressing thread, it fills the free buffers of the ring with 
+ * whole lines, the part of the last line of a buffer is moved to the next one.
+ */
+static void *
+runDemandDecompressor( void * arg )
+{
+    DemandDecompressor * dec = arg;
+    char               * carry;
+    char               * buf;
+    char               * last;
+    size_t               nrCarry = 0;
+    size_t               len;
+    size_t               n = 1;
+    long                 i;
+
+
+    carry = malloc( DECOMPRESSED_BUFFER_SIZE );
+    if ( NULL == carry )
+    {
+        fprintf( stderr, "failed to allocate memory for decompression\n" );
+        exit( 1 );
+    }
+
+    for ( i = 0; n > 0; i++ )
+    {
+        pthread_mutex_lock( &( dec->mutex ) );
+        while ( dec->nrFilled - dec->nrScanned >= NUM_DECOMPRESSED_BUFFER )
+        {
+            pthread_cond_wait( &( dec->cond ), &( dec->mutex ) );
+        }
+        pthread_mutex_unlock( &( dec->mutex ) );
+
+        buf = dec->buf[i % NUM_DECOMPRESSED_BUFFER];
+        memcpy( buf, carry, nrCarry );
+        len = nrCarry;
+        nrCarry = 0;
+
+        while ( len < DECOMPRESSED_BUFFER_SIZE )
+        {
+            dec->out = buf + len;
+            dec->nrOut = DECOMPRESSED_BUFFER_SIZE - len;
+
+            n = decompressDemand( dec );
+            if ( 0 == n )
+            {
+                break;
+            }
+
+            len += n;
+        }
+
+        // a line longer than a buffer is cut, and its parts are not demands
+
+        if ( n > 0 )
+        {
+            for ( last = buf + len - 1; last >= buf && '\n' != *last; last-- )
+            {
+            }
+
+            if ( last >= buf )
+            {
+                nrCarry = buf + len - ( last + 1 );
+                memcpy( carry, last + 1, nrCarry );
+                len -= nrCarry;
+            }
+        }
+
+        buf[len] = '\0';
+
+        pthread_mutex_lock( &( dec->mutex ) );
+        dec->len[i % NUM_DECOMPRESSED_BUFFER] = len;
+        dec->nrFilled++;
+        dec->isEnd = ( 0 == n );
+        pthread_cond_broadcast( &( dec->cond ) );
+        pthread_mutex_unlock( &( dec->mutex ) );
+    }
+
+    free( carry );
+
+    return NULL;
+}
+
+
+int
+readDemandFromCompressedStream( DemandQuery * query, FILE * file, int compression, char * err )
+{
+    DemandDecompressor * dec;
+    pthread_t            thread;
+    char               * buf;
+    char               * cptr;
+    char               * next;
+    size_t               len;
+    long                 i;
+    int                  isEnd;
+    int                  ret;
+    Demand               d;
+
+
+    dec = calloc( 1, sizeof( DemandDecompressor ) );
+    if ( NULL == dec )
+    {
+        fprintf( stderr, "failed to allocate memory for decompression\n" );
+        exit( 1 );
+    }
+
+    dec->file = file;
+    dec->compression = compression;
+    pthread_mutex_init( &( dec->mutex ), NULL );
+    pthread_cond_init( &( dec->cond ), NULL );
+
+    for ( i = 0; i < NUM_DECOMPRESSED_BUFFER; i++ )
+    {
+        dec->buf[i] = malloc( DECOMPRESSED_BUFFER_SIZE + 1 );
+        if ( NULL == dec->buf[i] )
+        {
+            fprintf( stderr, "failed to allocate memory for decompression\n" );
+            exit( 1 );
+        }
+    }
+
+#ifdef HAVE_ZLIB
+    // 15 + 32 is the largest window with gzip header detection
+
+    if ( COMPRESSION_GZIP == compression
+         && inflateInit2( &( dec->gzip ), 15 + 32 ) != Z_OK )
+    {
+        fprintf( stderr, "failed to initialize gzip decompression\n" );
+        exit( 1 );
+    }
+#endif
+
+#ifdef HAVE_ZSTD
+    if ( COMPRESSION_ZSTD == compression )
+    {
+        dec->zstd = ZSTD_createDCtx();
+        if ( NULL == dec->zstd )
+        {
+            fprintf( stderr, "failed to initialize zstd decompression\n" );
+            exit( 1 );
+        }
+    }
+#endif
+
+    ret = pthread_create( &thread, NULL, runDemandDecompressor, dec );
+    if ( 0 != ret )
+    {
+        fprintf( stderr, "failed to create thread: %s\n", strerror( ret ) );
+        exit( 1 );
+    }
+
+    for ( i = 0, isEnd = 0; ! isEnd; i++ )
+    {
+        pthread_mutex_lock( &( dec->mutex ) );
+        while ( dec->nrFilled <= i )
+        {
+            pthread_cond_wait( &( dec->cond ), &( dec->mutex ) );
+        }
+
+        isEnd = ( dec->isEnd && dec->nrFilled == i + 1 );
+        pthread_mutex_unlock( &( dec->mutex ) );
+
+        buf = dec->buf[i % NUM_DECOMPRESSED_BUFFER];
+        len = dec->len[i % NUM_DECOMPRESSED_BUFFER];
+
+        for ( cptr = buf; cptr < buf + len; cptr = next )
+        {
+            next = memchr( cptr, '\n', buf + len - cptr );
+            next = ( NULL == next ) ? buf + len : next + 1;
+
+            query->stats.nrRead++;
+
+            if ( NULL == scanDemand( cptr, &d ) )
+            {
+                query->stats.nrRejected++;
+            }
+            else if ( isDemandInFilter( &( query->filter ), &d ) )
+            {
+                processDemandInQuery( query, &d );
+            }
+        }
+
+        pthread_mutex_lock( &( dec->mutex ) );
+        dec->nrScanned++;
+        pthread_cond_broadcast( &( dec->cond ) );
+        pthread_mutex_unlock( &( dec->mutex ) );
+    }
+
+    pthread_join( thread, NULL );
+
+    // the lines before an error are already processed, the error is returned as the file 
+    // is not read to its end
+
+    ret = 0;
+    if ( '\0' != dec->err[0] )
+    {
+        snprintf( err, MAX_ERROR_LEN, "%s", dec->err );
+        ret = -1;
+    }
+
+#ifdef HAVE_ZLIB
+    if ( COMPRESSION_GZIP == compression )
+    {
+        inflateEnd( &( dec->gzip ) );
+    }
+#endif
+
+#ifdef HAVE_ZSTD
+    if ( COMPRESSION_ZSTD == compression )
+    {
+        ZSTD_freeDCtx( dec->zstd );
+    }
+#endif
+
+    for ( i = 0; i < NUM_DECOMPRESSED_BUFFER; i++ )
+    {
+        free( dec->buf[i] );
+    }
+
+    pthread_mutex_destroy( &( dec->mutex ) );
+    pthread_cond_destroy( &( dec->cond ) );
+    free( dec );
+
+    return ret;
+}
+
+
+typedef struct demandchunk DemandChunk;
+
+struct demandchunk
+{
+    DemandFilter    * filter;
+    char            * begin;
+    char            * end;
+    DemandBuffer      result;
+    DemandAggregate * agg;         // matching demands are aggregated instead of kept, or NULL
+    long              nrRead;
+    long              nrRejected;
+    long              nrMatched;
+    int               isScanned;
+};
+
+
+static void *
+scanDemandChunk( void * arg )
+{
+    DemandChunk * chunk = arg;
+    char        * cptr;
+    char        * next;
+    char          buf[BUFSIZ];
+    Demand        d;
+
+
+    for ( cptr = chunk->begin; cptr < chunk->end; cptr = next )
+    {
+        next = memchr( cptr, '\n', chunk->end - cptr );
+        if ( NULL != next )
+        {
+            next++;
+        }
+        else
+        {
+            // last line of file without newline, it is copied so that scanDemand 
+            // does not read beyond the mapped memory
+
+            next = chunk->end;
+
+            if ( ( size_t )( next - cptr ) >= sizeof buf )
+            {
+                break;
+            }
+
+            memcpy( buf, cptr, next - cptr );
+            buf[next - cptr] = '\0';
+            cptr = buf;
+        }
+
+        chunk->nrRead++;
+
+        if ( NULL == scanDemand( cptr, &d ) )
+        {
+            chunk->nrRejected++;
+        }
+        else if ( isDemandInFilter( chunk->filter, &d ) )
+        {
+            chunk->nrMatched++;
+
+            if ( NULL != chunk->agg )
+            {
+                insertDemandInAggregate( chunk->agg, &d );
+            }
+            else
+            {
+                appendDemand( &( chunk->result ), &d );
+            }
+        }
+    }
+
+    return NULL;
+}
+
+
+typedef struct demandchunkqueue DemandChunkQueue;
+
+struct demandchunkqueue
+{
+    DemandChunk   * chunk;
+    long            nrChunk;
+    long            next;         // next chunk, taken by the threads
+    long            nrProcessed;  // chunks processed in order after they are scanned
+    long            maxPending;   // chunks taken but not processed yet
+    pthread_mutex_t mutex;
+    pthread_cond_t  cond;
+};
+
+
+/* the threads take the chunks in order, and wait when maxPending chunks are taken but 
+ * not processed yet, so the memory of the matching demands is bounded while they are 
+ * printed as they are read.
+ */
+static void *
+scanDemandChunkInQueue( void * arg )
+{
+    DemandChunkQueue * queue = arg;
+    long               i;
+
+
+    pthread_mutex_lock( &( queue->mutex ) );
+
+    for ( ;; )
+    {
+        while ( queue->next < queue->nrChunk
+                && queue->next >= queue->nrProcessed + queue->maxPending )
+        {
+            pthread_cond_wait( &( queue->cond ), &( queue->mutex ) );
+        }
+
+        if ( queue->next >= queue->nrChunk )
+        {
+            break;
+        }
+
+        i = queue->next++;
+        pthread_mutex_unlock( &( queue->mutex ) );
+
+        scanDemandChunk( &( queue->chunk[i] ) );
+
+        pthread_mutex_lock( &( queue->mutex ) );
+        queue->chunk[i].isScanned = 1;
+        pthread_cond_broadcast( &( queue->cond ) );
+    }
+
+    pthread_mutex_unlock( &( queue->mutex ) );
+
+    return NULL;
+}
+
+
+typedef struct demandinputfile DemandInputFile;
+
+struct demandinputfile
+{
+    char * base;        // NULL when the file is read as a stream
+    size_t size;
+    int    isText;      // not a DemandCache or DemandCube
+    long   firstChunk;
+    long   nrChunk;
+};
+
+
+/* the function maps file into input, and returns -1 when it is not a regular file with 
+ * data or it can not be mapped, so it is read as a stream.
+ */
+static int
+mapDemandInputFile( FILE * file, DemandInputFile * input )
+{
+    struct stat st;
+
+
+    input->base = NULL;
+    input->size = 0;
+    input->isText = 0;
+    input->firstChunk = 0;
+    input->nrChunk = 0;
+
+    if ( fstat( fileno( file ), &st ) != 0
+         || ! S_ISREG( st.st_mode ) 
+         || st.st_size <= 0 )
+    {
+        return -1;
+    }
+
+    input->base = mmap( NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno( file ), 0 );
+    if ( MAP_FAILED == input->base )
+    {
+        input->base = NULL;
+        return -1;
+    }
+
+    // a compressed file is read as a stream by its decompressing thread
+
+    if ( getDemandCompression( ( unsigned char * ) input->base, st.st_size ) != COMPRESSION_NONE )
+    {
+        munmap( input->base, st.st_size );
+        input->base = NULL;
+        return -1;
+    }
+
+    input->size = st.st_size;
+    input->isText = ! isDemandCache( input->base, input->size ) && ! isDemandCube( input->base, input->size );
+
+    posix_madvise( input->base, input->size, POSIX_MADV_SEQUENTIAL );
+
+    return 0;
+}
+
+
+/* the function splits the mapped file of input into nrChunk chunks at chunk, every chunk 
+ * ends right after a newline except the last one, and returns the number of chunks.
+ */
+static long
+splitDemandInputFile( DemandQuery * query, DemandInputFile * input, long nrChunk, DemandChunk * chunk )
+{
+    char * base = input->base;
+    size_t size = input->size;
+    char * cptr = base;
+    char * end;
+    long   n = 0;
+
+
+    while ( cptr < base + size 
+            && n < nrChunk )
+    {
+        end = base + size / nrChunk * ( n + 1 );
+        if ( end <= cptr )
+        {
+            end = cptr;
+        }
+
+        if ( n == nrChunk - 1 )
+        {
+            end = base + size;
+        }
+        else
+        {
+            end = memchr( end, '\n', base + size - end );
+            end = ( NULL == end ) ? base + size : end + 1;
+        }
+
+        chunk[n].filter = &( query->filter );
+        chunk[n].begin = cptr;
+        chunk[n].end = end;
+        chunk[n].result.d = NULL;
+        chunk[n].result.nrDemand = 0;
+        chunk[n].result.maxDemand = 0;
+        chunk[n].agg = NULL;
+        chunk[n].nrRead = 0;
+        chunk[n].nrRejected = 0;
+        chunk[n].nrMatched = 0;
+        chunk[n].isScanned = 0;
+
+        if ( query->isApproximate )
+        {
+            chunk[n].agg = newDemandAggregate( query->agg->groupBy, query->agg->aggregate, query->agg->nrAggregate );
+        }
+
+        n++;
+
+        cptr = end;
+    }
+
+    return n;
+}
+
+
+int
+readDemand( DemandQuery * query, FILE * * file, int nrFile, int nrThread, char * err )
+{
+    DemandInputFile  * input;
+    DemandChunkQueue   queue;
+    pthread_t          thread[MAX_NUM_THREAD];
+    size_t             totalSize = 0;
+    long               maxChunk = 0;
+    long               nrChunk;
+    long               nrWorker;
+    long               i;
+    long               j;
+    int                ret;
+    int                status = 0;
+
+
+    input = malloc( nrFile * sizeof( input[0] ) );
+    if ( NULL == input )
+    {
+        fprintf( stderr, "failed to allocate memory for input files\n" );
+        exit( 1 );
+    }
+
+    for ( i = 0; i < nrFile; i++ )
+    {
+        if ( mapDemandInputFile( file[i], &( input[i] ) ) == 0
+             && input[i].isText )
+        {
+            totalSize += input[i].size;
+        }
+    }
+
+    // each text file has a share of nrThread chunks by its size, and at least one, so 
+    // the chunks of all files are about the same size and are scanned together. With -u, 
+    // a chunk is at most UNORDERED_CHUNK_SIZE bytes so its demands are printed soon
+
+    for ( i = 0; i < nrFile; i++ )
+    {
+        if ( input[i].isText )
+        {
+            input[i].nrChunk = ( long )( ( ( double ) input[i].size * nrThread + totalSize - 1 ) / totalSize );
+            input[i].nrChunk = ( input[i].nrChunk < 1 ) ? 1 : input[i].nrChunk;
+            input[i].nrChunk = ( input[i].nrChunk > nrThread ) ? nrThread : input[i].nrChunk;
+
+            if ( query->isUnordered
+                 && ( long )( input[i].size / UNORDERED_CHUNK_SIZE ) > input[i].nrChunk )
+            {
+                input[i].nrChunk = input[i].size / UNORDERED_CHUNK_SIZE;
+            }
+
+            maxChunk += input[i].nrChunk;
+        }
+    }
+
+    queue.chunk = malloc( ( maxChunk + 1 ) * sizeof( queue.chunk[0] ) );
+    if ( NULL == queue.chunk )
+    {
+        fprintf( stderr, "failed to allocate memory for input chunks\n" );
+        exit( 1 );
+    }
+
+    nrChunk = 0;
+    for ( i = 0; i < nrFile; i++ )
+    {
+        if ( input[i].isText )
+        {
+            input[i].firstChunk = nrChunk;
+            input[i].nrChunk = splitDemandInputFile( query, &( input[i] ), input[i].nrChunk, queue.chunk + nrChunk );
+            nrChunk += input[i].nrChunk;
+        }
+    }
+
+    queue.nrChunk = nrChunk;
+    queue.next = 0;
+    queue.nrProcessed = 0;
+    queue.maxPending = query->isUnordered ? NUM_PENDING_CHUNK_PER_THREAD * nrThread : nrChunk;
+    pthread_mutex_init( &( queue.mutex ), NULL );
+    pthread_cond_init( &( queue.cond ), NULL );
+
+    // with -u, all threads scan while this one prints the chunks in order as soon as 
+    // they are scanned, otherwise this thread scans too and the chunks are processed 
+    // after all of them are scanned
+
+    nrWorker = ( nrChunk < nrThread ) ? nrChunk : nrThread;
+
+    for ( i = query->isUnordered ? 0 : 1; i < nrWorker; i++ )
+    {
+        ret = pthread_create( &thread[i], NULL, scanDemandChunkInQueue, &queue );
+        if ( 0 != ret )
+        {
+            fprintf( stderr, "failed to create thread: %s\n", strerror( ret ) );
+            exit( 1 );
+        }
+    }
+
+    if ( ! query->isUnordered )
+    {
+        scanDemandChunkInQueue( &queue );
+    }
+
+    // the demands are processed in the order of the files and their chunks, so the 
+    // result is the same as reading the files one after another line by line. After 
+    // an error, the remaining files are not read but their chunks are still waited for 
+    // and freed, so that the threads can be joined
+
+    for ( i = 0; i < nrFile; i++ )
+    {
+        if ( NULL == input[i].base )
+        {
+            if ( 0 != status )
+            {
+                continue;
+            }
+
+            unsigned char c;
+            int           compression = COMPRESSION_NONE;
+
+
+            // only the first byte of a stream is put back, a demand line does not start 
+            // with the first byte of gzip or zstd
+
+            if ( fread( &c, 1, 1, file[i] ) == 1 )
+            {
+                compression = getDemandCompression( &c, 1 );
+                ungetc( c, file[i] );
+            }
+
+            if ( COMPRESSION_NONE == compression )
+            {
+                readDemandFromStream( query, file[i] );
+            }
+            else
+            {
+                status = readDemandFromCompressedStream( query, file[i], compression, err );
+            }
+
+            continue;
+        }
+
+        if ( ! input[i].isText
+             && 0 == status )
+        {
+            if ( isDemandCache( input[i].base, input[i].size ) )
+            {
+                status = readDemandFromCache( query, input[i].base, input[i].size, err );
+            }
+            else
+            {
+                status = readDemandFromCube( query, input[i].base, input[i].size, err );
+            }
+        }
+
+        for ( j = input[i].firstChunk; j < input[i].firstChunk + input[i].nrChunk; j++ )
+        {
+            long k;
+
+
+            pthread_mutex_lock( &( queue.mutex ) );
+            while ( ! queue.chunk[j].isScanned )
+            {
+                pthread_cond_wait( &( queue.cond ), &( queue.mutex ) );
+            }
+
+            pthread_mutex_unlock( &( queue.mutex ) );
+
+            if ( NULL != queue.chunk[j].agg )
+            {
+                if ( 0 == status )
+                {
+                    mergeDemandAggregate( query->agg, queue.chunk[j].agg );
+                    query->stats.nrMatched += queue.chunk[j].nrMatched;
+                }
+
+                deleteDemandAggregate( queue.chunk[j].agg );
+            }
+
+            for ( k = 0; 0 == status && k < queue.chunk[j].result.nrDemand; k++ )
+            {
+                processDemandInQuery( query, &( queue.chunk[j].result.d[k] ) );
+            }
+
+            query->stats.nrRead += queue.chunk[j].nrRead;
+            query->stats.nrRejected += queue.chunk[j].nrRejected;
+
+            free( queue.chunk[j].result.d );
+            queue.chunk[j].result.d = NULL;
+
+            pthread_mutex_lock( &( queue.mutex ) );
+            queue.nrProcessed = j + 1;
+            pthread_cond_broadcast( &( queue.cond ) );
+            pthread_mutex_unlock( &( queue.mutex ) );
+        }
+
+        munmap( input[i].base, input[i].size );
+    }
+
+    for ( i = query->isUnordered ? 0 : 1; i < nrWorker; i++ )
+    {
+        pthread_join( thread[i], NULL );
+    }
+
+    pthread_mutex_destroy( &( queue.mutex ) );
+    pthread_cond_destroy( &( queue.cond ) );
+
+    free( queue.chunk );
+    free( input );
+
+    return status;
+}
+
+
+/* the function appends the matching demands of the complete lines of fd from offset 
+ * into batch, and moves offset after the last complete line, so a line that is being 
+ * written is read again when it is complete. It returns 1 when the file is truncated 
+ * and read again from its start, like tail -f.
+ */
+int
+readAppendedDemand( DemandQuery * query, int fd, off_t * offset, DemandBuffer * batch )
+{
+    char        buf[BUFSIZ * 16];
+    char      * cptr;
+    char      * next;
+    ssize_t     n;
+    struct stat st;
+    int         isTruncated = 0;
+    Demand      d;
+
+
+    if ( fstat( fd, &st ) != 0 )
+    {
+        fprintf( stderr, "failed to follow file: %s\n", strerror( errno ) );
+        exit( 1 );
+    }
+
+    if ( st.st_size < *offset )
+    {
+        *offset = 0;
+        isTruncated = 1;
+    }
+
+    while ( ( n = pread( fd, buf, sizeof( buf ) - 1, *offset ) ) > 0 )
+    {
+        buf[n] = '\0';
+
+        for ( cptr = buf; ( next = memchr( cptr, '\n', buf + n - cptr ) ) != NULL; cptr = next + 1 )
+        {
+            query->stats.nrRead++;
+
+            if ( NULL == scanDemand( cptr, &d ) )
+            {
+                query->stats.nrRejected++;
+            }
+            else if ( isDemandInFilter( &( query->filter ), &d ) )
+            {
+                appendDemand( batch, &d );
+            }
+        }
+
+        // a line longer than buf is not a demand, it is skipped
+
+        if ( buf == cptr
+             && ( size_t ) n == sizeof( buf ) - 1 )
+        {
+            cptr = buf + n;
+        }
+
+        *offset += cptr - buf;
+
+        if ( ( size_t ) n < sizeof( buf ) - 1 )
+        {
+            break;
+        }
+    }
+
+    if ( n < 0 )
+    {
+        fprintf( stderr, "failed to follow file: %s\n", strerror( errno ) );
+        exit( 1 );
+    }
+
+    return isTruncated;
+}
+
+
+void
+readDemandFromFollowedFile( DemandQuery * query, int fd, off_t * offset )
+{
+    DemandBuffer batch = { NULL, 0, 0 };
+    long         i;
+
+
+    readAppendedDemand( query, fd, offset, &batch );
+
+    for ( i = 0; i < batch.nrDemand; i++ )
+    {
+        processDemandInQuery( query, &( batch.d[i] ) );
+    }
+
+    free( batch.d );
+}
+
+
+/* the function does not return, it waits for lines appended to fd from offset and 
+ * prints the new matching demands in the order they are appended, or with -a, the 
+ * changed groups in the order of their keys. When fd is truncated, the aggregates are 
+ * made again from its start and all of the groups are printed.
+ */
+void
+followDemand( DemandQuery * query, int fd, off_t offset )
+{
+    DemandBuffer      batch = { NULL, 0, 0 };
+    DemandInGroup * * changed = NULL;
+    long              maxChanged = 0;
+    DemandAggregate * agg;
+    long              i;
+    int               isTruncated;
+    struct timespec   interval = { FOLLOW_INTERVAL_MS / 1000, ( FOLLOW_INTERVAL_MS % 1000 ) * 1000000L };
+
+
+    while ( 1 )
+    {
+        batch.nrDemand = 0;
+        isTruncated = readAppendedDemand( query, fd, &offset, &batch );
+
+        if ( isTruncated )
+        {
+            fprintf( stderr, "file is truncated, it is followed from its start\n" );
+
+            query->stats.nrMatched = 0;
+        }
+
+        // the aggregates of a truncated file are made again from the demands read from 
+        // its start, and all of the groups are printed
+
+        if ( isTruncated
+             && NULL != query->agg )
+        {
+            agg = newDemandAggregate( query->agg->groupBy, query->agg->aggregate, query->agg->nrAggregate );
+            agg->scale = query->agg->scale;
+
+            deleteDemandAggregate( query->agg );
+            query->agg = agg;
+
+            for ( i = 0; i < batch.nrDemand; i++ )
+            {
+                insertDemandInAggregate( query->agg, &( batch.d[i] ) );
+            }
+
+            query->stats.nrMatched += batch.nrDemand;
+
+            printDemandAggregate( stdout, query->agg );
+            fflush( stdout );
+            continue;
+        }
+
+        if ( 0 == batch.nrDemand )
+        {
+            nanosleep( &interval, NULL );
+            continue;
+        }
+
+        query->stats.nrMatched += batch.nrDemand;
+
+        if ( NULL != query->agg )
+        {
+            if ( batch.nrDemand > maxChanged )
+            {
+                maxChanged = batch.maxDemand;
+
+                free( changed );
+                changed = malloc( maxChanged * sizeof( changed[0] ) );
+                if ( NULL == changed )
+                {
+                    fprintf( stderr, "failed to allocate memory for more DemandInGroup *\n" );
+                    exit( 1 );
+                }
+            }
+
+            for ( i = 0; i < batch.nrDemand; i++ )
+            {
+                changed[i] = insertDemandInAggregate( query->agg, &( batch.d[i] ) );
+            }
+
+            // the same group is next to itself after sorting by key
+
+            qsort( changed, batch.nrDemand, sizeof( changed[0] ), compareDemandInGroup );
+
+            for ( i = 0; i < batch.nrDemand; i++ )
+            {
+                if ( 0 == i 
+                     || changed[i] != changed[i - 1] )
+                {
+                    printDemandInGroup( stdout, query->agg, changed[i] );
+                }
+            }
+        }
+        else
+        {
+            for ( i = 0; i < batch.nrDemand; i++ )
+            {
+                printDemand( stdout, &( batch.d[i] ) );
+            }
+        }
+
+        fflush( stdout );
+    }
+}
+
+/* End of demand input API */
+
+
+/* Start of DemandCache API */
+
+static int
+compareDemandGeohash6( const void * a, const void * b )
+{
+    uint32_t ga = ( *( Demand * const * ) a )->geohash6;
+    uint32_t gb = ( *( Demand * const * ) b )->geohash6;
+
+
+    return ( ga > gb ) - ( ga < gb );
+}
+
+
+static uint64_t
+alignDemandCacheOffset( uint64_t offset )
+{
+    return ( offset + 7 ) & ~( uint64_t ) 7;
+}
+
+
+static void
+writeDemandCacheSection( FILE * file, char * path, uint64_t offset, void * data, size_t size )
+{
+    static const char padding[8] = { 0 };
+    long              pos;
+
+
+    pos = ftell( file );
+    if ( pos < 0 
+         || ( uint64_t ) pos > offset
+         || fwrite( padding, 1, offset - pos, file ) != offset - pos
+         || fwrite( data, 1, size, file ) != size )
+    {
+        fprintf( stderr, "write file error: %s\n", path );
+        exit( 1 );
+    }
+}
+
+
+/* the function returns a mix of the bits of geohash6 by splitmix64, the probe i of a bloom 
+ * filter is its low 32 bits plus i times its high 32 bits.
+ */
+static uint64_t
+getBloomHashOfGeohash6( uint32_t geohash6 )
+{
+    return getSplitMixHash( geohash6 );
+}
+
+
+static void
+insertGeohash6InBloom( uint64_t * bloom, uint32_t nrBit, uint32_t geohash6 )
+{
+    uint64_t hash = getBloomHashOfGeohash6( geohash6 );
+    uint32_t bit;
+    int      i;
+
+
+    for ( i = 0; i < NUM_BLOOM_HASH; i++ )
+    {
+        bit = ( ( uint32_t ) hash + i * ( uint32_t )( hash >> 32 ) ) & ( nrBit - 1 );
+        bloom[bit / BITS_IN_WORD] |= ( uint64_t ) 1 << ( bit % BITS_IN_WORD );
+    }
+}
+
+
+static int
+isGeohash6InBloom( uint64_t * bloom, uint32_t nrBit, uint32_t geohash6 )
+{
+    uint64_t hash = getBloomHashOfGeohash6( geohash6 );
+    uint32_t bit;
+    int      i;
+
+
+    for ( i = 0; i < NUM_BLOOM_HASH; i++ )
+    {
+        bit = ( ( uint32_t ) hash + i * ( uint32_t )( hash >> 32 ) ) & ( nrBit - 1 );
+        if ( 0 == ( bloom[bit / BITS_IN_WORD] & ( ( uint64_t ) 1 << ( bit % BITS_IN_WORD ) ) ) )
+        {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+
+void
+writeDemandCache( char * path, DemandBuffer * buf )
+{
+    DemandCacheHeader    header;
+    DemandCacheSegment   segment[DAYS_IN_YEAR + 1];
+    Demand           * * sorted;
+    uint32_t           * geohash6;
+    uint32_t           * idOfDemand;
+    uint32_t           * id;
+    uint16_t           * day;
+    uint16_t           * minute;
+    double             * value;
+    uint32_t           * position;
+    long               * order;
+    long               * lastSegment;
+    uint32_t           * distinct;
+    uint64_t           * bloom = NULL;
+    long                 count[DAYS_IN_YEAR + 1];
+    long                 nrDistinct;
+    long                 sum;
+    long                 from;
+    long                 i;
+    long                 j;
+    long                 n = buf->nrDemand;
+    int                  isInInputOrder = 1;
+    uint32_t             nrBit;
+    FILE               * file;
+
+
+    // the dictionary is built by sorting the demands by geohash6, so a geohash6 
+    // gets its index when it differs from the one before it
+
+    sorted = malloc( ( n + 1 ) * sizeof( Demand * ) );
+    geohash6 = malloc( ( n + 1 ) * sizeof( geohash6[0] ) );
+    idOfDemand = malloc( ( n + 1 ) * sizeof( idOfDemand[0] ) );
+    id = malloc( ( n + 1 ) * sizeof( id[0] ) );
+    day = malloc( ( n + 1 ) * sizeof( day[0] ) );
+    minute = malloc( ( n + 1 ) * sizeof( minute[0] ) );
+    value = malloc( ( n + 1 ) * sizeof( value[0] ) );
+    position = malloc( ( n + 1 ) * sizeof( position[0] ) );
+    order = malloc( ( n + 1 ) * sizeof( order[0] ) );
+    if ( NULL == sorted
+         || NULL == geohash6 
+         || NULL == idOfDemand
+         || NULL == id
+         || NULL == day
+         || NULL == minute
+         || NULL == value
+         || NULL == position
+         || NULL == order )
+    {
+        fprintf( stderr, "failed to allocate memory for DemandCache\n" );
+        exit( 1 );
+    }
+
+    for ( i = 0; i < n; i++ )
+    {
+        sorted[i] = &( buf->d[i] );
+    }
+
+    qsort( sorted, n, sizeof( sorted[0] ), compareDemandGeohash6 );
+
+    memset( &header, 0, sizeof( header ) );
+    for ( i = 0; i < n; i++ )
+    {
+        if ( 0 == i 
+             || sorted[i]->geohash6 != geohash6[header.nrGeohash6 - 1] )
+        {
+            geohash6[header.nrGeohash6++] = sorted[i]->geohash6;
+        }
+
+        idOfDemand[sorted[i] - buf->d] = header.nrGeohash6 - 1;
+    }
+
+    // the demands are sorted by day by counting them, so they keep their order within a day
+
+    memset( count, 0, sizeof( count ) );
+    for ( i = 0; i < n; i++ )
+    {
+        count[buf->d[i].day]++;
+    }
+
+    for ( sum = 0, i = 0; i <= DAYS_IN_YEAR; i++ )
+    {
+        j = count[i];
+        count[i] = sum;
+        sum += j;
+    }
+
+    for ( i = 0; i < n; i++ )
+    {
+        order[count[buf->d[i].day]++] = i;
+    }
+
+    for ( i = 0; i < n; i++ )
+    {
+        id[i] = idOfDemand[order[i]];
+        day[i] = buf->d[order[i]].day;
+        minute[i] = buf->d[order[i]].hh * MINS_IN_HOUR + buf->d[order[i]].mm;
+        value[i] = buf->d[order[i]].value;
+        position[i] = order[i];
+
+        isInInputOrder = isInInputOrder && ( order[i] == i );
+    }
+
+    if ( ! isInInputOrder 
+         && n > ( long ) UINT32_MAX )
+    {
+        fprintf( stderr, "cache file holds up to %lu demands that are not in the order of day\n", ( unsigned long ) UINT32_MAX );
+        exit( 1 );
+    }
+
+    // a segment ends at the end of a day once it has enough demands, its bloom filter 
+    // has BITS_IN_BLOOM_PER_GEOHASH6 bits for each of its geohash6
+
+    lastSegment = malloc( ( header.nrGeohash6 + 1 ) * sizeof( lastSegment[0] ) );
+    distinct = malloc( ( header.nrGeohash6 + 1 ) * sizeof( distinct[0] ) );
+    if ( NULL == lastSegment
+         || NULL == distinct )
+    {
+        fprintf( stderr, "failed to allocate memory for DemandCache\n" );
+        exit( 1 );
+    }
+
+    for ( i = 0; i < header.nrGeohash6; i++ )
+    {
+        lastSegment[i] = -1;
+    }
+
+    for ( from = 0, i = 1; i <= n; i++ )
+    {
+        if ( i < n 
+             && ( day[i] == day[i - 1] 
+                  || i - from < MIN_NUM_DEMAND_IN_SEGMENT ) )
+        {
+            continue;
+        }
+
+        memset( &( segment[header.nrSegment] ), 0, sizeof( segment[0] ) );
+        segment[header.nrSegment].from = from;
+        segment[header.nrSegment].to = i;
+        segment[header.nrSegment].minDay = day[from];
+        segment[header.nrSegment].maxDay = day[i - 1];
+
+        nrDistinct = 0;
+        for ( j = from; j < i; j++ )
+        {
+            segment[header.nrSegment].minInterval[( minute[j] / MIN_IN_MININTERVAL ) / BITS_IN_WORD] |= 
+                ( uint64_t ) 1 << ( ( minute[j] / MIN_IN_MININTERVAL ) % BITS_IN_WORD );
+
+            if ( lastSegment[id[j]] != header.nrSegment )
+            {
+                lastSegment[id[j]] = header.nrSegment;
+                distinct[nrDistinct++] = geohash6[id[j]];
+            }
+        }
+
+        nrBit = BITS_IN_WORD;
+        while ( nrBit < nrDistinct * BITS_IN_BLOOM_PER_GEOHASH6 )
+        {
+            nrBit *= 2;
+        }
+
+        bloom = realloc( bloom, ( header.nrBloomWord + nrBit / BITS_IN_WORD ) * sizeof( bloom[0] ) );
+        if ( NULL == bloom )
+        {
+            fprintf( stderr, "failed to allocate memory for DemandCache\n" );
+            exit( 1 );
+        }
+
+        memset( bloom + header.nrBloomWord, 0, nrBit / BITS_IN_WORD * sizeof( bloom[0] ) );
+
+        for ( j = 0; j < nrDistinct; j++ )
+        {
+            insertGeohash6InBloom( bloom + header.nrBloomWord, nrBit, distinct[j] );
+        }
+
+        segment[header.nrSegment].nrBloomBit = nrBit;
+        segment[header.nrSegment].bloomWord = header.nrBloomWord;
+        header.nrBloomWord += nrBit / BITS_IN_WORD;
+        header.nrSegment++;
+        from = i;
+    }
+
+    memcpy( header.magic, DEMAND_CACHE_MAGIC, sizeof( DEMAND_CACHE_MAGIC ) );
+    header.byteOrder = DEMAND_CACHE_BYTE_ORDER;
+    header.version = DEMAND_CACHE_VERSION;
+    header.nrDemand = n;
+    header.geohash6Offset = alignDemandCacheOffset( sizeof( header ) );
+    header.idOffset = alignDemandCacheOffset( header.geohash6Offset + header.nrGeohash6 * sizeof( geohash6[0] ) );
+    header.dayOffset = alignDemandCacheOffset( header.idOffset + n * sizeof( id[0] ) );
+    header.minuteOffset = alignDemandCacheOffset( header.dayOffset + n * sizeof( day[0] ) );
+    header.valueOffset = alignDemandCacheOffset( header.minuteOffset + n * sizeof( minute[0] ) );
+    header.segmentOffset = alignDemandCacheOffset( header.valueOffset + n * sizeof( value[0] ) );
+    header.bloomOffset = alignDemandCacheOffset( header.segmentOffset + header.nrSegment * sizeof( segment[0] ) );
+
+    if ( ! isInInputOrder )
+    {
+        header.positionOffset = alignDemandCacheOffset( header.bloomOffset + header.nrBloomWord * sizeof( bloom[0] ) );
+    }
+
+    file = fopen( path, "wb" );
+    if ( NULL == file )
+    {
+        fprintf( stderr, "open file error: %s\n", path );
+        exit( 1 );
+    }
+
+    writeDemandCacheSection( file, path, 0, &header, sizeof( header ) );
+    writeDemandCacheSection( file, path, header.geohash6Offset, geohash6, header.nrGeohash6 * sizeof( geohash6[0] ) );
+    writeDemandCacheSection( file, path, header.idOffset, id, n * sizeof( id[0] ) );
+    writeDemandCacheSection( file, path, header.dayOffset, day, n * sizeof( day[0] ) );
+    writeDemandCacheSection( file, path, header.minuteOffset, minute, n * sizeof( minute[0] ) );
+    writeDemandCacheSection( file, path, header.valueOffset, value, n * sizeof( value[0] ) );
+    writeDemandCacheSection( file, path, header.segmentOffset, segment, header.nrSegment * sizeof( segment[0] ) );
+    writeDemandCacheSection( file, path, header.bloomOffset, bloom, header.nrBloomWord * sizeof( bloom[0] ) );
+
+    if ( ! isInInputOrder )
+    {
+        writeDemandCacheSection( file, path, header.positionOffset, position, n * sizeof( position[0] ) );
+    }
+
+    if ( fclose( file ) != 0 )
+    {
+        fprintf( stderr, "write file error: %s\n", path );
+        exit( 1 );
+    }
+
+    free( sorted );
+    free( geohash6 );
+    free( idOfDemand );
+    free( id );
+    free( day );
+    free( minute );
+    free( value );
+    free( position );
+    free( order );
+    free( lastSegment );
+    free( distinct );
+    free( bloom );
+}
+
+
+int
+isDemandCache( char * base, size_t size )
+{
+    return size >= sizeof( DemandCacheHeader ) 
+           && memcmp( base, DEMAND_CACHE_MAGIC, sizeof( DEMAND_CACHE_MAGIC ) ) == 0;
+}
+
+
+/* the function returns whether the demands of segment can match filter by its zone map, 
+ * isMinIntervalMatched is the min intervals of the day of filter, and probe the nrProbe 
+ * geohash6 of the dictionary matching filter, nrProbe is -1 when all of them are matched 
+ * or they are too many to be looked up in the bloom filter.
+ */
+static int
+isDemandCacheSegmentInFilter( DemandCacheSegment * segment, uint64_t * bloom, DemandFilter * filter, uint64_t * isMinIntervalMatched, uint32_t * probe, long nrProbe )
+{
+    uint64_t isAny = 0;
+    int      isMatched = 0;
+    long     i;
+
+
+    for ( i = segment->minDay; ! isMatched && i <= segment->maxDay; i++ )
+    {
+        isMatched = filter->day[i - 1];
+    }
+
+    for ( i = 0; i < ( long ) ( sizeof( segment->minInterval ) / sizeof( segment->minInterval[0] ) ); i++ )
+    {
+        isAny |= segment->minInterval[i] & isMinIntervalMatched[i];
+    }
+
+    isMatched = isMatched && 0 != isAny;
+
+    if ( isMatched 
+         && nrProbe >= 0 )
+    {
+        for ( isMatched = 0, i = 0; ! isMatched && i < nrProbe; i++ )
+        {
+            isMatched = isGeohash6InBloom( bloom + segment->bloomWord, segment->nrBloomBit, probe[i] );
+        }
+    }
+
+    return isMatched;
+}
+
+
+/* the function sorts the keys of matching demands, their position in the input in the 
+ * high 32 bits and their row in the low 32 bits, by position with a radix sort.
+ */
+static void
+sortDemandCachePosition( uint64_t * key, uint64_t * tmp, long nrKey, uint64_t nrDemand )
+{
+    long       count[NUM_RADIX];
+    uint64_t * from = key;
+    uint64_t * to = tmp;
+    uint64_t * swap;
+    long       i;
+    long       sum;
+    long       n;
+    int        shift;
+
+
+    for ( shift = 0; shift < 32 && ( nrDemand - 1 ) >> shift != 0; shift += BITS_IN_RADIX )
+    {
+        memset( count, 0, sizeof( count ) );
+
+        for ( i = 0; i < nrKey; i++ )
+        {
+            count[( from[i] >> ( 32 + shift ) ) & ( NUM_RADIX - 1 )]++;
+        }
+
+        for ( sum = 0, i = 0; i < NUM_RADIX; i++ )
+        {
+            n = count[i];
+            count[i] = sum;
+            sum += n;
+        }
+
+        for ( i = 0; i < nrKey; i++ )
+        {
+            to[count[( from[i] >> ( 32 + shift ) ) & ( NUM_RADIX - 1 )]++] = from[i];
+        }
+
+        swap = from;
+        from = to;
+        to = swap;
+    }
+
+    if ( from != key )
+    {
+        memcpy( key, from, nrKey * sizeof( key[0] ) );
+    }
+}
+
+
+static void
+getDemandOfCache( DemandColumn * column, uint32_t * geohash6, uint64_t i, Demand * d )
+{
+    d->geohash6 = geohash6[column->id[i]];
+    d->day = column->day[i];
+    d->hh = column->minute[i] / MINS_IN_HOUR;
+    d->mm = column->minute[i] % MINS_IN_HOUR;
+    d->value = column->value[i];
+}
+
+
+int
+readDemandFromCache( DemandQuery * query, char * base, size_t size, char * err )
+{
+    DemandCacheHeader  * header = ( DemandCacheHeader * ) base;
+    DemandFilter       * filter = &( query->filter );
+    DemandCacheSegment * segment;
+    uint32_t           * geohash6;
+    uint32_t           * position = NULL;
+    uint64_t           * bloom;
+    char               * isGeohash6Matched;
+    uint32_t             probe[MAX_NUM_BLOOM_PROBE];
+    long                 nrProbe;
+    uint64_t             isMinIntervalMatched[( MININTERVALS_IN_DAY * HOURS_IN_DAY + BITS_IN_WORD - 1 ) / BITS_IN_WORD];
+    DemandColumn         column;
+    DemandInGroup      * group = NULL;
+    uint64_t             bitmap[NUM_DEMAND_IN_BLOCK / BITS_IN_WORD];
+    uint64_t           * key = NULL;
+    uint64_t           * tmp;
+    long                 nrKey = 0;
+    long                 maxKey = 0;
+    uint64_t             word;
+    uint64_t             n;
+    uint64_t             i;
+    uint64_t             j;
+    uint64_t             k;
+    uint64_t             from;
+    uint64_t             to;
+    long                 nrMatched;
+    int                  isAggregated;
+    Demand               d;
+
+
+    n = header->nrDemand;
+
+    if ( header->byteOrder != DEMAND_CACHE_BYTE_ORDER
+         || header->version != DEMAND_CACHE_VERSION )
+    {
+        snprintf( err, MAX_ERROR_LEN, "cache file is built by another version or another machine, please rebuild it" );
+        return -1;
+    }
+
+    if ( n > size
+         || header->nrGeohash6 > size
+         || header->nrSegment > size
+         || header->nrBloomWord > size
+         || header->geohash6Offset + header->nrGeohash6 * sizeof( geohash6[0] ) > size
+         || header->idOffset + n * sizeof( column.id[0] ) > size
+         || header->dayOffset + n * sizeof( column.day[0] ) > size
+         || header->minuteOffset + n * sizeof( column.minute[0] ) > size
+         || header->valueOffset + n * sizeof( column.value[0] ) > size
+         || header->segmentOffset + header->nrSegment * sizeof( segment[0] ) > size
+         || header->bloomOffset + header->nrBloomWord * sizeof( bloom[0] ) > size
+         || ( 0 != header->positionOffset
+              && header->positionOffset + n * sizeof( position[0] ) > size ) )
+    {
+        snprintf( err, MAX_ERROR_LEN, "cache file is truncated, please rebuild it" );
+        return -1;
+    }
+
+    geohash6 = ( uint32_t * )( base + header->geohash6Offset );
+    segment = ( DemandCacheSegment * )( base + header->segmentOffset );
+    bloom = ( uint64_t * )( base + header->bloomOffset );
+
+    // the segments are checked before any of them is read, so that a corrupted cache is 
+    // not answered in part
+
+    for ( k = 0; k < header->nrSegment; k++ )
+    {
+        if ( segment[k].from > segment[k].to
+             || segment[k].to > n
+             || segment[k].minDay < 1
+             || segment[k].maxDay > DAYS_IN_YEAR
+             || segment[k].nrBloomBit < BITS_IN_WORD
+             || 0 != ( segment[k].nrBloomBit & ( segment[k].nrBloomBit - 1 ) )
+             || segment[k].bloomWord + segment[k].nrBloomBit / BITS_IN_WORD > header->nrBloomWord )
+        {
+            snprintf( err, MAX_ERROR_LEN, "cache file is corrupted, please rebuild it" );
+            return -1;
+        }
+    }
+
+    if ( 0 != header->positionOffset )
+    {
+        position = ( uint32_t * )( base + header->positionOffset );
+    }
+
+    // geohash6 filter is matched against the sorted dictionary rather than each demand, 
+    // and the matching geohash6 are looked up in the bloom filters of the segments when 
+    // they are a few
+
+    isGeohash6Matched = malloc( header->nrGeohash6 + 1 );
+    column.isIdMatched = malloc( ( header->nrGeohash6 + 1 ) * sizeof( column.isIdMatched[0] ) );
+    if ( NULL == isGeohash6Matched
+         || NULL == column.isIdMatched )
+    {
+        fprintf( stderr, "failed to allocate memory for DemandCache\n" );
+        exit( 1 );
+    }
+
+    markGeohash6InFilter( filter, geohash6, header->nrGeohash6, isGeohash6Matched );
+
+    nrProbe = ( NULL == filter->geohash6 ) ? -1 : 0;
+    for ( i = 0; nrProbe >= 0 && i < header->nrGeohash6; i++ )
+    {
+        if ( ! isGeohash6Matched[i] )
+        {
+            continue;
+        }
+
+        if ( nrProbe < MAX_NUM_BLOOM_PROBE )
+        {
+            probe[nrProbe++] = geohash6[i];
+        }
+        else
+        {
+            nrProbe = -1;
+        }
+    }
+
+    memset( isMinIntervalMatched, 0, sizeof( isMinIntervalMatched ) );
+    for ( i = 0; i < MININTERVALS_IN_DAY * HOURS_IN_DAY; i++ )
+    {
+        if ( filter->hourMinInterval[i] )
+        {
+            isMinIntervalMatched[i / BITS_IN_WORD] |= ( uint64_t ) 1 << ( i % BITS_IN_WORD );
+        }
+    }
+
+    column.id = ( uint32_t * )( base + header->idOffset );
+    column.day = ( uint16_t * )( base + header->dayOffset );
+    column.minute = ( uint16_t * )( base + header->minuteOffset );
+    column.value = ( double * )( base + header->valueOffset );
+    column.nrGeohash6 = header->nrGeohash6;
+    compileDemandColumnFilter( &column, filter, isGeohash6Matched );
+
+    // aggregates without group by are computed from the columns, stddev and the sketches 
+    // are not as they are updated demand by demand, sum and mean are not when the demands 
+    // are not in input order, so that they are added in the same order as reading the input, 
+    // and min and max are not either, as the first of 0 and -0, or a nan first demand, is 
+    // kept like reading the input. None of them are when demands are sampled
+
+    isAggregated = ( NULL != query->agg 
+                     && 0 == query->agg->groupBy 
+                     && UINT64_MAX == filter->sampleThreshold );
+    for ( i = 0; isAggregated && i < ( uint64_t ) query->agg->nrAggregate; i++ )
+    {
+        isAggregated = ( AGGREGATE_COUNT == query->agg->aggregate[i]
+                         || ( NULL == position 
+                              && ( AGGREGATE_SUM == query->agg->aggregate[i] 
+                                   || AGGREGATE_MEAN == query->agg->aggregate[i]
+                                   || AGGREGATE_MIN == query->agg->aggregate[i]
+                                   || AGGREGATE_MAX == query->agg->aggregate[i] ) ) );
+    }
+
+    for ( k = 0; k < header->nrSegment; k++ )
+    {
+        // the pages of a segment that can not match are not touched at all
+
+        if ( ! isDemandCacheSegmentInFilter( &( segment[k] ), bloom, filter, isMinIntervalMatched, probe, nrProbe ) )
+        {
+            continue;
+        }
+
+        query->stats.nrRead += segment[k].to - segment[k].from;
+
+        for ( from = segment[k].from; from < segment[k].to; from = to )
+        {
+            to = ( segment[k].to - from > NUM_DEMAND_IN_BLOCK ) ? from + NUM_DEMAND_IN_BLOCK : segment[k].to;
+
+            nrMatched = matchDemandColumn( &column, from, to, bitmap );
+            if ( 0 == nrMatched )
+            {
+                continue;
+            }
+
+            for ( j = 0; j < ( to - from + BITS_IN_WORD - 1 ) / BITS_IN_WORD; j++ )
+            {
+                for ( word = bitmap[j]; 0 != word; word &= word - 1 )
+                {
+                    i = from + j * BITS_IN_WORD + __builtin_ctzll( word );
+
+                    if ( isAggregated )
+                    {
+                        // the group starts with min and max of the first matched demand
+
+                        if ( NULL == group )
+                        {
+                            getDemandOfCache( &column, geohash6, i, &d );
+                            group = insertGroupInAggregate( query->agg, &d );
+                        }
+
+                        break;
+                    }
+                    else if ( NULL != position )
+                    {
+                        // the demand is processed once all matching demands are put back 
+                        // in input order
+
+                        if ( nrKey >= maxKey )
+                        {
+                            maxKey = ( 0 == maxKey ) ? NUM_DEMAND_IN_BLOCK : maxKey * 2;
+                            key = realloc( key, maxKey * sizeof( key[0] ) );
+                            if ( NULL == key )
+                            {
+                                fprintf( stderr, "failed to allocate memory for DemandCache\n" );
+                                exit( 1 );
+                            }
+                        }
+
+                        key[nrKey++] = ( ( uint64_t ) position[i] << 32 ) | i;
+                    }
+                    else
+                    {
+                        getDemandOfCache( &column, geohash6, i, &d );
+                        if ( isDemandSampled( filter, &d ) )
+                        {
+                            processDemandInQuery( query, &d );
+                        }
+                    }
+                }
+
+                if ( NULL != group )
+                {
+                    break;
+                }
+            }
+
+            if ( isAggregated )
+            {
+                aggregateDemandColumn( &column, from, to, bitmap, group );
+                query->stats.nrMatched += nrMatched;
+            }
+        }
+    }
+
+    if ( nrKey > 0 )
+    {
+        tmp = malloc( nrKey * sizeof( tmp[0] ) );
+        if ( NULL == tmp )
+        {
+            fprintf( stderr, "failed to allocate memory for DemandCache\n" );
+            exit( 1 );
+        }
+
+        sortDemandCachePosition( key, tmp, nrKey, n );
+
+        for ( i = 0; i < ( uint64_t ) nrKey; i++ )
+        {
+            getDemandOfCache( &column, geohash6, key[i] & UINT32_MAX, &d );
+            if ( isDemandSampled( filter, &d ) )
+            {
+                processDemandInQuery( query, &d );
+            }
+        }
+
+        free( tmp );
+    }
+
+    free( key );
+    free( column.isIdMatched );
+    free( isGeohash6Matched );
+
+    return 0;
+}
+
+/* End of DemandCache API */
+
+
+/* Start of DemandColumn API */
+
+void
+compileDemandColumnFilter( DemandColumn * column, DemandFilter * filter, char * isGeohash6Matched )
+{
+    int i;
+
+
+    for ( i = 0; i < ( int ) column->nrGeohash6; i++ )
+    {
+        column->isIdMatched[i] = isGeohash6Matched[i] ? -1 : 0;
+    }
+
+    column->isIdMatched[column->nrGeohash6] = 0;
+
+    column->isDayMatched[0] = 0;
+    for ( i = 1; i <= DAYS_IN_YEAR; i++ )
+    {
+        column->isDayMatched[i] = filter->day[i - 1] ? -1 : 0;
+    }
+
+    column->isDayMatched[DAYS_IN_YEAR + 1] = 0;
+
+    for ( i = 0; i < HOURS_IN_DAY * MINS_IN_HOUR; i++ )
+    {
+        column->isMinuteMatched[i] = filter->hourMinInterval[i / MIN_IN_MININTERVAL] ? -1 : 0;
+    }
+
+    column->isMinuteMatched[HOURS_IN_DAY * MINS_IN_HOUR] = 0;
+}
+
+
+/* the scalar kernels work on the rows from begin of the block from, so they also do the 
+ * rows after the last 8 or 4 rows of the AVX2 kernels.
+ */
+static long
+matchDemandColumnScalar( DemandColumn * column, uint64_t from, uint64_t begin, uint64_t to, uint64_t * bitmap )
+{
+    uint64_t i;
+    uint32_t id;
+    uint32_t day;
+    uint32_t minute;
+    int32_t  isMatched;
+    long     nrMatched = 0;
+
+
+    for ( i = begin; i < to; i++ )
+    {
+        id = column->id[i];
+        day = column->day[i];
+        minute = column->minute[i];
+
+        id = ( id < column->nrGeohash6 ) ? id : column->nrGeohash6;
+        day = ( day <= DAYS_IN_YEAR ) ? day : DAYS_IN_YEAR + 1;
+        minute = ( minute < HOURS_IN_DAY * MINS_IN_HOUR ) ? minute : HOURS_IN_DAY * MINS_IN_HOUR;
+
+        isMatched = column->isIdMatched[id] & column->isDayMatched[day] & column->isMinuteMatched[minute] & 1;
+
+        bitmap[( i - from ) / BITS_IN_WORD] |= ( uint64_t ) isMatched << ( ( i - from ) % BITS_IN_WORD );
+        nrMatched += isMatched;
+    }
+
+    return nrMatched;
+}
+
+
+static void
+aggregateDemandColumnScalar( DemandColumn * column, uint64_t from, uint64_t begin, uint64_t to, uint64_t * bitmap, DemandInGroup * group )
+{
+    uint64_t j;
+    uint64_t word;
+    double   value;
+
+
+    for ( j = ( begin - from ) / BITS_IN_WORD; j < ( to - from + BITS_IN_WORD - 1 ) / BITS_IN_WORD; j++ )
+    {
+        word = bitmap[j];
+        if ( j == ( begin - from ) / BITS_IN_WORD )
+        {
+            word &= ~( uint64_t ) 0 << ( ( begin - from ) % BITS_IN_WORD );
+        }
+
+        for ( ; 0 != word; word &= word - 1 )
+        {
+            value = column->value[from + j * BITS_IN_WORD + __builtin_ctzll( word )];
+
+            group->cnt++;
+            group->sum += value;
+
+            if ( value < group->min )
+            {
+                group->min = value;
+            }
+
+            if ( value > group->max )
+            {
+                group->max = value;
+            }
+        }
+    }
+}
+
+
+#ifdef HAVE_AVX2_KERNEL
+
+__attribute__(( target( "avx2" ) ))
+static long
+matchDemandColumnAvx2( DemandColumn * column, uint64_t from, uint64_t to, uint64_t * bitmap )
+{
+    __m256i  maxId = _mm256_set1_epi32( column->nrGeohash6 );
+    __m256i  maxDay = _mm256_set1_epi32( DAYS_IN_YEAR + 1 );
+    __m256i  maxMinute = _mm256_set1_epi32( HOURS_IN_DAY * MINS_IN_HOUR );
+    __m256i  id;
+    __m256i  day;
+    __m256i  minute;
+    __m256i  isMatched;
+    uint64_t i;
+    uint32_t bits;
+    long     nrMatched = 0;
+
+
+    // the bits of bitmap are from the row from, and i - from is a multiple of 8, so the 
+    // 8 bits of rows are in the same word of bitmap
+
+    for ( i = from; i + 8 <= to; i += 8 )
+    {
+        id = _mm256_min_epu32( _mm256_loadu_si256( ( __m256i * )( column->id + i ) ), maxId );
+        day = _mm256_min_epu32( _mm256_cvtepu16_epi32( _mm_loadu_si128( ( __m128i * )( column->day + i ) ) ), maxDay );
+        minute = _mm256_min_epu32( _mm256_cvtepu16_epi32( _mm_loadu_si128( ( __m128i * )( column->minute + i ) ) ), maxMinute );
+
+        isMatched = _mm256_and_si256( _mm256_i32gather_epi32( ( int * ) column->isIdMatched, id, 4 ),
+                                      _mm256_and_si256( _mm256_i32gather_epi32( ( int * ) column->isDayMatched, day, 4 ),
+                                                        _mm256_i32gather_epi32( ( int * ) column->isMinuteMatched, minute, 4 ) ) );
+
+        bits = _mm256_movemask_ps( _mm256_castsi256_ps( isMatched ) );
+
+        bitmap[( i - from ) / BITS_IN_WORD] |= ( uint64_t ) bits << ( ( i - from ) % BITS_IN_WORD );
+        nrMatched += __builtin_popcount( bits );
+    }
+
+    // the upper halves of the registers are cleared, or the SSE code after the kernel, 
+    // like log of libm, pays for the transition on every instruction
+
+    _mm256_zeroupper();
+
+    return nrMatched + matchDemandColumnScalar( column, from, i, to, bitmap );
+}
+
+
+__attribute__(( target( "avx2" ) ))
+static void
+aggregateDemandColumnAvx2( DemandColumn * column, uint64_t from, uint64_t to, uint64_t * bitmap, DemandInGroup * group )
+{
+    __m256i  bit = _mm256_setr_epi64x( 1, 2, 4, 8 );
+    __m256d  inf = _mm256_set1_pd( INFINITY );
+    __m256d  minusInf = _mm256_set1_pd( -INFINITY );
+    __m256d  min = inf;
+    __m256d  max = minusInf;
+    __m256d  value;
+    __m256d  isMatched;
+    double   lane[8];
+    double   blockMin = INFINITY;
+    double   blockMax = -INFINITY;
+    uint64_t i;
+    uint64_t j;
+    uint32_t bits;
+    uint32_t word;
+    int      k;
+
+
+    for ( i = from; i + 4 <= to; i += 4 )
+    {
+        bits = ( bitmap[( i - from ) / BITS_IN_WORD] >> ( ( i - from ) % BITS_IN_WORD ) ) & 0xf;
+        if ( 0 == bits )
+        {
+            continue;
+        }
+
+        // a value that is not matched is inf for min and -inf for max, and min and max 
+        // keep their value when the value is nan like the comparisons of the scalar kernel
+
+        isMatched = _mm256_castsi256_pd( _mm256_cmpeq_epi64( _mm256_and_si256( _mm256_set1_epi64x( bits ), bit ), bit ) );
+        value = _mm256_loadu_pd( column->value + i );
+
+        min = _mm256_min_pd( _mm256_blendv_pd( inf, value, isMatched ), min );
+        max = _mm256_max_pd( _mm256_blendv_pd( minusInf, value, isMatched ), max );
+
+        for ( word = bits; 0 != word; word &= word - 1 )
+        {
+            group->sum += column->value[i + __builtin_ctz( word )];
+        }
+
+        group->cnt += __builtin_popcount( bits );
+    }
+
+    _mm256_storeu_pd( lane, min );
+    _mm256_storeu_pd( lane + 4, max );
+
+    _mm256_zeroupper();
+
+    for ( k = 0; k < 4; k++ )
+    {
+        blockMin = ( lane[k] < blockMin ) ? lane[k] : blockMin;
+        blockMax = ( lane[4 + k] > blockMax ) ? lane[4 + k] : blockMax;
+    }
+
+    // 0 and -0 are equal but printed differently, the scalar kernel keeps the first of 
+    // them while the lanes keep the first of each lane, so a zero min or max is taken 
+    // again from the rows in their order
+
+    if ( 0.0 == blockMin
+         || 0.0 == blockMax )
+    {
+        for ( j = from; j < i; j++ )
+        {
+            if ( ( bitmap[( j - from ) / BITS_IN_WORD] >> ( ( j - from ) % BITS_IN_WORD ) ) & 1 )
+            {
+                group->min = ( column->value[j] < group->min ) ? column->value[j] : group->min;
+                group->max = ( column->value[j] > group->max ) ? column->value[j] : group->max;
+            }
+        }
+    }
+    else
+    {
+        group->min = ( blockMin < group->min ) ? blockMin : group->min;
+        group->max = ( blockMax > group->max ) ? blockMax : group->max;
+    }
+
+    if ( i < to )
+    {
+        aggregateDemandColumnScalar( column, from, i, to, bitmap, group );
+    }
+}
+
+#endif
+
+
+/* the function sets the bits of bitmap for the matched rows from and before to, to - from 
+ * is up to NUM_DEMAND_IN_BLOCK and bit 0 of bitmap is the row from, which is any row, and 
+ * returns the number of them.
+ */
+long
+matchDemandColumn( DemandColumn * column, uint64_t from, uint64_t to, uint64_t * bitmap )
+{
+    memset( bitmap, 0, ( to - from + BITS_IN_WORD - 1 ) / BITS_IN_WORD * sizeof( bitmap[0] ) );
+
+#ifdef HAVE_AVX2_KERNEL
+    if ( __builtin_cpu_supports( "avx2" ) )
+    {
+        return matchDemandColumnAvx2( column, from, to, bitmap );
+    }
+#endif
+
+    return matchDemandColumnScalar( column, from, from, to, bitmap );
+}
+
+
+/* the function adds the matched values of the rows from and before to into group, which 
+ * has min and max of one of them already.
+ */
+void
+aggregateDemandColumn( DemandColumn * column, uint64_t from, uint64_t to, uint64_t * bitmap, DemandInGroup * group )
+{
+#ifdef HAVE_AVX2_KERNEL
+    if ( __builtin_cpu_supports( "avx2" ) )
+    {
+        aggregateDemandColumnAvx2( column, from, to, bitmap, group );
+        return;
+    }
+#endif
+
+    aggregateDemandColumnScalar( column, from, from, to, bitmap, group );
+}
+
+/* End of DemandColumn API */
+
+
+/* Start of DemandCube API */
+
+enum
+{
+    NUM_CUBE_COLUMN = MININTERVALS_IN_DAY * HOURS_IN_DAY + 1
+};
+
+
+/* the function adds bhi + blo to the double-double hi + lo, the rounding error of adding 
+ * the high parts is kept by TwoSum, so the sum has about 106 bits and the prefix sums of 
+ * a cube are differenced without losing the digits of a small range.
+ */
+static void
+addDoubleDouble( double * hi, double * lo, double bhi, double blo )
+{
+    double s = *hi + bhi;
+    double v = s - *hi;
+    double e = ( *hi - ( s - v ) ) + ( bhi - v );
+
+
+    e += *lo + blo;
+    *hi = s + e;
+    *lo = e - ( *hi - s );
+}
+
+
+void
+writeDemandCube( char * path, DemandBuffer * buf )
+{
+    DemandCubeHeader    header;
+    Demand          * * sorted;
+    uint32_t          * geohash6;
+    uint8_t           * isScanned;
+    double            * cell;
+    double            * sum;
+    double            * sumLow;
+    uint32_t          * cnt;
+    double              rowSum;
+    double              rowSumLow;
+    long                nrCell;
+    long                n = buf->nrDemand;
+    long                i;
+    long                j;
+    long                k;
+    long                d;
+    long                t;
+    FILE              * file;
+
+
+    sorted = malloc( ( n + 1 ) * sizeof( Demand * ) );
+    geohash6 = malloc( ( n + 1 ) * sizeof( geohash6[0] ) );
+    if ( NULL == sorted
+         || NULL == geohash6 )
+    {
+        fprintf( stderr, "failed to allocate memory for DemandCube\n" );
+        exit( 1 );
+    }
+
+    memset( &header, 0, sizeof( header ) );
+    for ( i = 0; i < n; i++ )
+    {
+        sorted[i] = &( buf->d[i] );
+
+        if ( ( uint32_t ) buf->d[i].day > header.nrDay )
+        {
+            header.nrDay = buf->d[i].day;
+        }
+    }
+
+    qsort( sorted, n, sizeof( sorted[0] ), compareDemandGeohash6 );
+
+    for ( i = 0; i < n; i++ )
+    {
+        if ( 0 == i 
+             || sorted[i]->geohash6 != geohash6[header.nrGeohash6 - 1] )
+        {
+            geohash6[header.nrGeohash6++] = sorted[i]->geohash6;
+        }
+    }
+
+    nrCell = ( header.nrDay + 1 ) * NUM_CUBE_COLUMN;
+    isScanned = calloc( header.nrGeohash6 + 1, sizeof( isScanned[0] ) );
+    cell = malloc( nrCell * sizeof( cell[0] ) );
+    sum = malloc( nrCell * sizeof( sum[0] ) );
+    sumLow = malloc( nrCell * sizeof( sumLow[0] ) );
+    cnt = malloc( nrCell * sizeof( cnt[0] ) );
+    if ( NULL == isScanned
+         || NULL == cell
+         || NULL == sum
+         || NULL == sumLow
+         || NULL == cnt )
+    {
+        fprintf( stderr, "failed to allocate memory for DemandCube\n" );
+        exit( 1 );
+    }
+
+    memcpy( header.magic, DEMAND_CUBE_MAGIC, sizeof( DEMAND_CUBE_MAGIC ) );
+    header.byteOrder = DEMAND_CACHE_BYTE_ORDER;
+    header.version = DEMAND_CUBE_VERSION;
+    header.geohash6Offset = alignDemandCacheOffset( sizeof( header ) );
+    header.cellOffset = alignDemandCacheOffset( header.geohash6Offset + header.nrGeohash6 * sizeof( geohash6[0] ) );
+    header.cellSize = alignDemandCacheOffset( nrCell * ( sizeof( sum[0] ) + sizeof( sumLow[0] ) + sizeof( cnt[0] ) ) );
+    header.scanOffset = header.cellOffset + header.nrGeohash6 * header.cellSize;
+
+    file = fopen( path, "wb" );
+    if ( NULL == file )
+    {
+        fprintf( stderr, "open file error: %s\n", path );
+        exit( 1 );
+    }
+
+    writeDemandCacheSection( file, path, 0, &header, sizeof( header ) );
+    writeDemandCacheSection( file, path, header.geohash6Offset, geohash6, header.nrGeohash6 * sizeof( geohash6[0] ) );
+
+    // the demands of a geohash6 are next to each other after sorting, each block is 
+    // filled with the sum of each cell, turned into double-double prefix sums along min 
+    // interval and then along day, and written
+
+    for ( i = 0, k = 0; k < header.nrGeohash6; k++ )
+    {
+        memset( cell, 0, nrCell * sizeof( cell[0] ) );
+        memset( sum, 0, nrCell * sizeof( sum[0] ) );
+        memset( sumLow, 0, nrCell * sizeof( sumLow[0] ) );
+        memset( cnt, 0, nrCell * sizeof( cnt[0] ) );
+
+        for ( ; i < n && sorted[i]->geohash6 == geohash6[k]; i++ )
+        {
+            j = sorted[i]->day * NUM_CUBE_COLUMN + sorted[i]->hh * MININTERVALS_IN_DAY + sorted[i]->mm / MIN_IN_MININTERVAL + 1;
+
+            cell[j] += sorted[i]->value;
+            cnt[j]++;
+        }
+
+        for ( d = 1; d <= header.nrDay; d++ )
+        {
+            rowSum = 0.0;
+            rowSumLow = 0.0;
+
+            for ( t = 1; t < NUM_CUBE_COLUMN; t++ )
+            {
+                j = d * NUM_CUBE_COLUMN + t;
+
+                addDoubleDouble( &rowSum, &rowSumLow, cell[j], 0.0 );
+
+                sum[j] = sum[j - NUM_CUBE_COLUMN];
+                sumLow[j] = sumLow[j - NUM_CUBE_COLUMN];
+                addDoubleDouble( &( sum[j] ), &( sumLow[j] ), rowSum, rowSumLow );
+
+                cnt[j] += cnt[j - 1];
+            }
+        }
+
+        for ( d = 2; d <= header.nrDay; d++ )
+        {
+            for ( t = 1; t < NUM_CUBE_COLUMN; t++ )
+            {
+                cnt[d * NUM_CUBE_COLUMN + t] += cnt[( d - 1 ) * NUM_CUBE_COLUMN + t];
+            }
+        }
+
+        // a prefix sum that is not finite, from inf, -inf, nan or a sum beyond the largest 
+        // double, is not differenced, the block keeps the sum of each cell instead
+
+        for ( j = 0; j < nrCell && ! isScanned[k]; j++ )
+        {
+            isScanned[k] = ! isfinite( sum[j] ) || ! isfinite( sumLow[j] );
+        }
+
+        if ( isScanned[k] )
+        {
+            memcpy( sum, cell, nrCell * sizeof( sum[0] ) );
+            memset( sumLow, 0, nrCell * sizeof( sumLow[0] ) );
+        }
+
+        writeDemandCacheSection( file, path, header.cellOffset + k * header.cellSize, sum, nrCell * sizeof( sum[0] ) );
+        writeDemandCacheSection( file, path, header.cellOffset + k * header.cellSize + nrCell * sizeof( sum[0] ), sumLow, nrCell * sizeof( sumLow[0] ) );
+        writeDemandCacheSection( file, path, header.cellOffset + k * header.cellSize + nrCell * ( sizeof( sum[0] ) + sizeof( sumLow[0] ) ), cnt, nrCell * sizeof( cnt[0] ) );
+    }
+
+    // the scan flags are only known after the blocks, they follow the last block, which is 
+    // padded to cellSize like the others
+
+    writeDemandCacheSection( file, path, header.scanOffset, isScanned, header.nrGeohash6 * sizeof( isScanned[0] ) );
+
+    if ( fclose( file ) != 0 )
+    {
+        fprintf( stderr, "write file error: %s\n", path );
+        exit( 1 );
+    }
+
+    free( sorted );
+    free( geohash6 );
+    free( isScanned );
+    free( cell );
+    free( sum );
+    free( sumLow );
+    free( cnt );
+}
+
+
+int
+isDemandCube( char * base, size_t size )
+{
+    return size >= sizeof( DemandCubeHeader ) 
+           && memcmp( base, DEMAND_CUBE_MAGIC, sizeof( DEMAND_CUBE_MAGIC ) ) == 0;
+}
+
+
+/* the function collects the ranges of consecutive set flags, from[i] to to[i] are 
+ * indexes of flag, and returns the number of ranges.
+ */
+static int
+getRangeOfFlag( int * flag, int nrFlag, int * from, int * to )
+{
+    int nrRange = 0;
+    int i;
+
+
+    for ( i = 0; i < nrFlag; i++ )
+    {
+        if ( flag[i] )
+        {
+            if ( 0 == i 
+                 || ! flag[i - 1] )
+            {
+                from[nrRange] = i;
+            }
+
+            to[nrRange] = i;
+
+            if ( i == nrFlag - 1
+                 || ! flag[i + 1] )
+            {
+                nrRange++;
+            }
+        }
+    }
+
+    return nrRange;
+}
+
+
+int
+readDemandFromCube( DemandQuery * query, char * base, size_t size, char * err )
+{
+    DemandCubeHeader * header = ( DemandCubeHeader * ) base;
+    DemandFilter     * filter = &( query->filter );
+    uint32_t         * geohash6;
+    uint8_t          * isScanned;
+    double           * sum;
+    double           * sumLow;
+    uint32_t         * cnt;
+    int                dayFrom[DAYS_IN_YEAR];
+    int                dayTo[DAYS_IN_YEAR];
+    int                minIntervalFrom[NUM_CUBE_COLUMN];
+    int                minIntervalTo[NUM_CUBE_COLUMN];
+    int                nrDayRange;
+    int                nrMinIntervalRange;
+    char             * isGeohash6Matched;
+    long               nrCell;
+    long               i;
+    int                j;
+    int                k;
+    long               row;
+    long               col;
+    Demand             d = { 0, 0, 0, 0, 0.0 };
+
+
+    if ( NULL == query->agg
+         || ( query->agg->groupBy & ~GROUP_BY_GEOHASH6 ) != 0 )
+    {
+        snprintf( err, MAX_ERROR_LEN, "cube file only answers -a with or without -kgeohash" );
+        return -1;
+    }
+
+    for ( i = 0; i < query->agg->nrAggregate; i++ )
+    {
+        if ( AGGREGATE_COUNT != query->agg->aggregate[i]
+             && AGGREGATE_SUM != query->agg->aggregate[i]
+             && AGGREGATE_MEAN != query->agg->aggregate[i] )
+        {
+            snprintf( err, MAX_ERROR_LEN, "cube file only answers count, sum and mean aggregates" );
+            return -1;
+        }
+    }
+
+    if ( UINT64_MAX != query->filter.sampleThreshold )
+    {
+        snprintf( err, MAX_ERROR_LEN, "cube file answers from prefix sums of all demands, it is not sampled" );
+        return -1;
+    }
+
+    if ( header->byteOrder != DEMAND_CACHE_BYTE_ORDER
+         || header->version != DEMAND_CUBE_VERSION )
+    {
+        snprintf( err, MAX_ERROR_LEN, "cube file is built by another version or another machine, please rebuild it" );
+        return -1;
+    }
+
+    nrCell = ( header->nrDay + 1 ) * NUM_CUBE_COLUMN;
+
+    if ( header->nrDay > DAYS_IN_YEAR
+         || header->nrGeohash6 > size
+         || header->cellSize < nrCell * ( sizeof( sum[0] ) + sizeof( sumLow[0] ) + sizeof( cnt[0] ) )
+         || header->geohash6Offset + header->nrGeohash6 * sizeof( geohash6[0] ) > size
+         || header->scanOffset + header->nrGeohash6 * sizeof( isScanned[0] ) > size
+         || header->cellOffset + header->nrGeohash6 * header->cellSize > size )
+    {
+        snprintf( err, MAX_ERROR_LEN, "cube file is truncated, please rebuild it" );
+        return -1;
+    }
+
+    geohash6 = ( uint32_t * )( base + header->geohash6Offset );
+    isScanned = ( uint8_t * )( base + header->scanOffset );
+
+    // -d and -t are turned into ranges of day and min interval, days beyond the cube 
+    // are dropped
+
+    nrDayRange = getRangeOfFlag( filter->day, header->nrDay, dayFrom, dayTo );
+    nrMinIntervalRange = getRangeOfFlag( filter->hourMinInterval, NUM_CUBE_COLUMN - 1, minIntervalFrom, minIntervalTo );
+
+    isGeohash6Matched = malloc( header->nrGeohash6 + 1 );
+    if ( NULL == isGeohash6Matched )
+    {
+        fprintf( stderr, "failed to allocate memory for DemandCube\n" );
+        exit( 1 );
+    }
+
+    markGeohash6InFilter( filter, geohash6, header->nrGeohash6, isGeohash6Matched );
+
+    for ( i = 0; i < header->nrGeohash6; i++ )
+    {
+        double totalSum = 0.0;
+        double totalSumLow = 0.0;
+        long   totalCnt = 0;
+
+
+        sum = ( double * )( base + header->cellOffset + i * header->cellSize );
+        sumLow = sum + nrCell;
+        cnt = ( uint32_t * )( sumLow + nrCell );
+
+        query->stats.nrRead += cnt[nrCell - 1];
+
+        if ( ! isGeohash6Matched[i] )
+        {
+            continue;
+        }
+
+        // with prefix sums P, the sum of day a to b and min interval c to e is 
+        // P[b][e] - P[a - 1][e] - P[b][c - 1] + P[a - 1][c - 1], where the flag index 
+        // of day is 1 less and of min interval is 1 less than its position in the block, 
+        // the sum of value is kept as double-double and rounded once at the end, a block 
+        // of the sum of each cell is added cell by cell in time order instead
+
+        for ( j = 0; j < nrDayRange; j++ )
+        {
+            long upper = ( dayTo[j] + 1 ) * NUM_CUBE_COLUMN;
+            long lower = dayFrom[j] * NUM_CUBE_COLUMN;
+
+
+            for ( row = dayFrom[j] + 1; isScanned[i] && row <= dayTo[j] + 1; row++ )
+            {
+                for ( k = 0; k < nrMinIntervalRange; k++ )
+                {
+                    for ( col = minIntervalFrom[k] + 1; col <= minIntervalTo[k] + 1; col++ )
+                    {
+                        totalSum += sum[row * NUM_CUBE_COLUMN + col];
+                    }
+                }
+            }
+
+            for ( k = 0; k < nrMinIntervalRange; k++ )
+            {
+                long right = minIntervalTo[k] + 1;
+                long left = minIntervalFrom[k];
+
+
+                if ( ! isScanned[i] )
+                {
+                    addDoubleDouble( &totalSum, &totalSumLow, sum[upper + right], sumLow[upper + right] );
+                    addDoubleDouble( &totalSum, &totalSumLow, -sum[lower + right], -sumLow[lower + right] );
+                    addDoubleDouble( &totalSum, &totalSumLow, -sum[upper + left], -sumLow[upper + left] );
+                    addDoubleDouble( &totalSum, &totalSumLow, sum[lower + left], sumLow[lower + left] );
+                }
+
+                totalCnt += cnt[upper + right] - cnt[lower + right] - cnt[upper + left] + cnt[lower + left];
+            }
+        }
+
+        if ( totalCnt > 0 )
+        {
+            d.geohash6 = geohash6[i];
+
+            mergeDemandInAggregate( query->agg, &d, totalCnt, totalSum );
+            query->stats.nrMatched += totalCnt;
+        }
+    }
+
+    free( isGeohash6Matched );
+
+    return 0;
+}
+
+/* End of DemandCube API */
+
+
+/* Start of DemandQuery API */
+
+void
+initDemandFilter( DemandFilter * filter )
+{
+    int i;
+
+
+    for ( i = 0; i < DAYS_IN_YEAR; i++ )
+    {
+        filter->day[i] = 1;
+    }
+
+    for ( i = 0; i < MININTERVALS_IN_DAY * HOURS_IN_DAY; i++ )
+    {
+	filter->hourMinInterval[i] = 1;
+    }
+
+    filter->geohash6 = NULL;
+    filter->nrGeohash6 = 0;
+    filter->maxGeohash6 = 0;
+    filter->isPrefixAny = NULL;
+    filter->isPrefixAll = NULL;
+    filter->sampleThreshold = UINT64_MAX;
+
+    memset( filter->minInterval, 0xff, sizeof( filter->minInterval ) );
+}
+
+
+/* the function sorts the geohash6 ranges of filter and compiles it into bitsets, it is 
+ * called once all of -g, -b, -d and -t are parsed.
+ */
+void
+compileDemandFilter( DemandFilter * filter )
+{
+    long     words = NUM_GEOHASH6_PREFIX / BITS_IN_WORD;
+    int      shift = ( GEOHASH6_LEN - GEOHASH6_PREFIX_LEN ) * BITS_IN_GEOHASH_CHAR;
+    uint32_t suffix = ( 1U << shift ) - 1;
+    uint32_t prefix;
+    uint32_t first;
+    uint32_t last;
+    long     i;
+    int      j;
+
+
+    memset( filter->minInterval, 0, sizeof( filter->minInterval ) );
+
+    for ( i = 0; i < DAYS_IN_YEAR; i++ )
+    {
+        for ( j = 0; filter->day[i] && j < MININTERVALS_IN_DAY * HOURS_IN_DAY; j++ )
+        {
+            if ( filter->hourMinInterval[j] )
+            {
+                filter->minInterval[( i * MININTERVALS_IN_DAY * HOURS_IN_DAY + j ) / BITS_IN_WORD] |= 
+                    ( uint64_t ) 1 << ( ( i * MININTERVALS_IN_DAY * HOURS_IN_DAY + j ) % BITS_IN_WORD );
+            }
+        }
+    }
+
+    sortGeohash6Range( filter );
+
+    free( filter->isPrefixAny );
+    filter->isPrefixAny = NULL;
+    filter->isPrefixAll = NULL;
+
+    if ( NULL == filter->geohash6 )
+    {
+        return;
+    }
+
+    filter->isPrefixAny = calloc( 2 * words, sizeof( filter->isPrefixAny[0] ) );
+    if ( NULL == filter->isPrefixAny )
+    {
+        fprintf( stderr, "failed to allocate memory for geohash6 filter\n" );
+        exit( 1 );
+    }
+
+    filter->isPrefixAll = filter->isPrefixAny + words;
+
+    // a prefix is all matched when a range starts at or before its first geohash6 and 
+    // ends at or after its last one, the merged ranges do not touch each other
+
+    for ( i = 0; i < filter->nrGeohash6; i++ )
+    {
+        first = filter->geohash6[i].from >> shift;
+        last = filter->geohash6[i].to >> shift;
+
+        for ( prefix = first; prefix <= last; prefix++ )
+        {
+            filter->isPrefixAny[prefix / BITS_IN_WORD] |= ( uint64_t ) 1 << ( prefix % BITS_IN_WORD );
+
+            if ( ( prefix > first || 0 == ( filter->geohash6[i].from & suffix ) )
+                 && ( prefix < last || suffix == ( filter->geohash6[i].to & suffix ) ) )
+            {
+                filter->isPrefixAll[prefix / BITS_IN_WORD] |= ( uint64_t ) 1 << ( prefix % BITS_IN_WORD );
+            }
+        }
+    }
+}
+
+
+/* the function adds geohash6 values and prefixes of s into filter, the geohash6 values 
+ * are also inserted into listed in the order they are given. s is changed by strtok_r.
+ */
+int
+parseGeohash6Filter( DemandFilter * filter, char * s, DemandInGeohash6Table * listed, char * err )
+{
+    char * tok;
+    char * save;
+    long   value;
+
+
+    for ( tok = strtok_r( s, ",", &save ); NULL != tok; tok = strtok_r( NULL, ",", &save ) )
+    {
+        if ( strchr( tok, '*' ) != NULL )
+        {
+            if ( insertGeohash6PrefixRange( filter, tok ) < 0 )
+            {
+                snprintf( err, MAX_ERROR_LEN, "Invalid argument to -g, %s is not a geohash prefix followed by *", tok );
+                return -1;
+            }
+        }
+        else
+        {
+            value = encodeGeohash6( tok );
+            if ( value < 0 )
+            {
+                snprintf( err, MAX_ERROR_LEN, "Invalid argument to -g, %s is not a geohash6 value", tok );
+                return -1;
+            }
+
+            insertGeohash6( listed, value, 1 );
+            insertGeohash6Range( filter, value, value );
+        }
+    }
+
+    return 0;
+}
+
+
+int
+parseGeohash6BoxFilter( DemandFilter * filter, char * s, char * err )
+{
+    if ( insertGeohash6BoxRange( filter, s ) < 0 )
+    {
+        snprintf( err, MAX_ERROR_LEN, "Invalid argument to -b%s, example -b-5.48,90.6,-5.24,90.99 for latitude and longitude from and to", s );
+        return -1;
+    }
+
+    return 0;
+}
+
+
+int
+parseDayFilter( DemandFilter * filter, char * s, char * err )
+{
+    int    i;
+    int    ret;
+    int    dayFrom;
+    int    dayTo;
+    char * save;
+
+
+    for ( i = 0; i < DAYS_IN_YEAR; i++ )
+    {
+        filter->day[i] = 0;
+    }
+
+    for ( ret = parseRange( s, &dayFrom, &dayTo, &save ); ret > 0; ret = parseRange( NULL, &dayFrom, &dayTo, &save ) )
+    {
+        if ( dayFrom <= 0  
+             || dayTo <= 0
+             || dayTo > DAYS_IN_YEAR )
+        {
+            snprintf( err, MAX_ERROR_LEN, "argument to -d must be 1 and less than 366" );
+            return -1;
+        }
+ 
+        if ( dayFrom > dayTo )
+        {
+            snprintf( err, MAX_ERROR_LEN, "start range argument must be less than or equal to end range argument, example -d1..3" );
+            return -1;
+        }
+
+        for ( i = dayFrom - 1; i < dayTo; i++ )
+        {
+            filter->day[i] = 1;
+        }
+    }
+
+    if ( ret < 0 )
+    {
+        snprintf( err, MAX_ERROR_LEN, "Invalid argument to -d%s", s );
+        return -1;
+    }
+
+    return 0;
+}
+
+
+int
+parseTimeFilter( DemandFilter * filter, char * s, char * err )
+{
+    int    i;
+    int    ret;
+    int    hourMinFrom;
+    int    hourMinTo;
+    int    hourFrom;
+    int    hourTo;
+    int    minFrom;
+    int    minTo;
+    char * save;
+
+
+    for ( i = 0; i < MININTERVALS_IN_DAY * HOURS_IN_DAY; i++ )
+    {
+        filter->hourMinInterval[i] = 0;
+    }
+
+    for ( ret = parseRange( s, &hourMinFrom, &hourMinTo, &save ); ret > 0; ret = parseRange( NULL, &hourMinFrom, &hourMinTo, &save ) )
+    {
+        if ( hourMinFrom > hourMinTo )
+        {
+            snprintf( err, MAX_ERROR_LEN, "Invalid argument to -t, start range argument must be less than or equal to end range argument, example -t1000..1045" );
+            return -1;
+        }
+
+        hourFrom = hourMinFrom / 100;
+        hourTo = hourMinTo / 100;
+        minFrom = hourMinFrom % 100;
+        minTo = hourMinTo % 100;
+
+        if ( hourFrom >= HOURS_IN_DAY 
+             || hourTo >= HOURS_IN_DAY 
+             || minFrom >= MINS_IN_HOUR
+             || minTo >= MINS_IN_HOUR )
+        {
+            snprintf( err, MAX_ERROR_LEN, "Invalid argument to -t, 1015 means hour 10 and min 15" );
+            return -1;
+        }
+
+        for ( i = hourFrom * MININTERVALS_IN_DAY + minFrom / MIN_IN_MININTERVAL; 
+              i <= hourTo * MININTERVALS_IN_DAY + minTo / MIN_IN_MININTERVAL; 
+              i++ )
+        {
+            filter->hourMinInterval[i] = 1;   
+        }
+    }
+
+    if ( ret < 0 )
+    {
+        snprintf( err, MAX_ERROR_LEN, "Invalid argument to -t%s", s );
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/* the function parses a query line sent to the server, options are separated by spaces, 
+ * and an argument either follows its option like -gqp03tu or is the next word like -g qp03tu.
+ * query must be initialized, and its aggregate is created when -a is given.
+ */
+int
+parseDemandQuery( DemandQuery * query, char * line, DemandInGeohash6Table * listed, char * err )
+{
+    static const char * sep = " \t\r\n";
+    char              * save = NULL;
+    char              * tok;
+    char              * arg;
+    int                 aggregate[NUM_AGGREGATE];
+    int                 nrAggregate = 0;
+    int                 groupBy = 0;
+    int                 ret = 0;
+
+
+    for ( tok = strtok_r( line, sep, &save ); NULL != tok && ret >= 0; tok = strtok_r( NULL, sep, &save ) )
+    {
+        if ( '-' != tok[0] 
+             || '\0' == tok[1] )
+        {
+            snprintf( err, MAX_ERROR_LEN, "invalid option %s", tok );
+            return -1;
+        }
+
+        arg = tok + 2;
+        if ( '\0' == *arg )
+        {
+            arg = strtok_r( NULL, sep, &save );
+            if ( NULL == arg )
+            {
+                snprintf( err, MAX_ERROR_LEN, "option %s requires an argument", tok );
+                return -1;
+            }
+        }
+
+        switch ( tok[1] )
+        {
+            case 'g':
+                ret = parseGeohash6Filter( &( query->filter ), arg, listed, err );
+                break;
+
+            case 'b':
+                ret = parseGeohash6BoxFilter( &( query->filter ), arg, err );
+                break;
+
+            case 'd':
+                ret = parseDayFilter( &( query->filter ), arg, err );
+                break;
+
+            case 't':
+                ret = parseTimeFilter( &( query->filter ), arg, err );
+                break;
+
+            case 'a':
+                snprintf( err, MAX_ERROR_LEN, "Invalid argument to -a%s, example -acount,sum,mean,min,max,stddev", arg );
+                nrAggregate = parseAggregate( arg, aggregate );
+                ret = ( nrAggregate > 0 ) ? 0 : -1;
+                break;
+
+            case 'k':
+                snprintf( err, MAX_ERROR_LEN, "Invalid argument to -k%s, example -kgeohash,day,hour or -kinterval", arg );
+                groupBy = parseGroupBy( arg );
+                ret = groupBy;
+                break;
+
+            default:
+                snprintf( err, MAX_ERROR_LEN, "invalid option %s", tok );
+                ret = -1;
+        }
+    }
+
+    if ( ret < 0 )
+    {
+        return -1;
+    }
+
+    if ( groupBy != 0
+         && nrAggregate == 0 )
+    {
+        snprintf( err, MAX_ERROR_LEN, "-k is only used with -a" );
+        return -1;
+    }
+
+    if ( nrAggregate > 0 )
+    {
+        query->agg = newDemandAggregate( groupBy, aggregate, nrAggregate );
+    }
+
+    compileDemandFilter( &( query->filter ) );
+
+    return 0;
+}
+
+
+
+/* the function samples rate of the demands matched by query, from more than 0 to 1, and 
+ * scales count and sum of its aggregates by 1 / rate.
+ */
+void
+setSampleRateOfDemandQuery( DemandQuery * query, double rate )
+{
+    query->filter.sampleThreshold = ( rate >= 1.0 ) ? UINT64_MAX : ( uint64_t )( rate * 18446744073709551616.0 );
+
+    if ( NULL != query->agg )
+    {
+        query->agg->scale = 1.0 / rate;
+    }
+}
+
+/* End of DemandQuery API */
+
+
+/* Start of DemandIndex API */
+
+typedef struct demandingeohash6order DemandInGeohash6Order;
+
+struct demandingeohash6order
+{
+    long hashkey;
+    long rank;
+    long id;
+};
+
+
+static int
+compareDemandInGeohash6Order( const void * a, const void * b )
+{
+    const DemandInGeohash6Order * oa = a;
+    const DemandInGeohash6Order * ob = b;
+
+
+    if ( oa->hashkey != ob->hashkey )
+    {
+        return oa->hashkey < ob->hashkey ? -1 : 1;
+    }
+
+    // the latest geohash6 was at the head of its chained bucket
+
+    return oa->rank > ob->rank ? -1 : oa->rank < ob->rank;
+}
+
+
+static int
+compareDemandInGeohash6Slot( const void * a, const void * b )
+{
+    const DemandInGeohash6Slot * sa = a;
+    const DemandInGeohash6Slot * sb = b;
+
+
+    return sa->geohash6 < sb->geohash6 ? -1 : sa->geohash6 > sb->geohash6;
+}
+
+
+static int
+compareDemandPosition( const void * a, const void * b )
+{
+    const Demand * da = *( Demand * const * ) a;
+    const Demand * db = *( Demand * const * ) b;
+
+
+    return da < db ? -1 : da > db;
+}
+
+
+/* demands of a geohash6 in the same min interval used to be printed in the order of their 
+ * nodes of NUM_DEMAND_PER_NODE demands, the latest node first. The function returns where the 
+ * k-th of nrDemand demands of a geohash6 is placed, so that the stable sort by time keeps 
+ * that order.
+ */
+static long
+getPositionInGeohash6( long k, long nrDemand )
+{
+    long start;
+
+
+    start = nrDemand - ( k / NUM_DEMAND_PER_NODE + 1 ) * NUM_DEMAND_PER_NODE;
+
+    return ( start > 0 ? start : 0 ) + k % NUM_DEMAND_PER_NODE;
+}
+
+
+typedef struct demandindexsort DemandIndexSort;
+
+struct demandindexsort
+{
+    DemandIndex * index;
+    Demand  * * tmp;
+    long          next;  // next cell to be sorted, taken by the threads
+};
+
+
+static void *
+sortDemandIndexThread( void * arg )
+{
+    DemandIndexSort * sort = arg;
+    DemandIndex     * index = sort->index;
+    long              i;
+
+
+    while ( ( i = __sync_fetch_and_add( &( sort->next ), 1 ) ) < index->cell->nrGeohash6 )
+    {
+        sortDemandInTime( index->d + index->offset[i], sort->tmp + index->offset[i], index->cell->item[i].nrDemand );
+    }
+
+    return NULL;
+}
+
+
+DemandIndex *
+newDemandIndex( DemandBuffer * buf, int nrThread )
+{
+    DemandIndex          * index;
+    DemandInGeohash6     * hashItem;
+    DemandInGeohash6Slot * sorted;
+    DemandIndexSort        sort;
+    pthread_t              thread[MAX_NUM_THREAD];
+    Demand             * * tmp;
+    int32_t              * cellOfDemand;
+    long                 * nrFilled;
+    char                   geohash6[GEOHASH6_LEN + 1];
+    long                   nrGeohash6;
+    long                   nrDemand = 0;
+    long                   id;
+    long                   i;
+    int                    ret;
+
+
+    index = malloc( sizeof( DemandIndex ) );
+    if ( NULL == index )
+    {
+        fprintf( stderr, "failed to allocate memory for DemandIndex\n" );
+        exit( 1 );
+    }
+
+    index->buf = buf;
+    index->cell = newDemandInGeohash6();
+
+    cellOfDemand = malloc( ( buf->nrDemand + 1 ) * sizeof( cellOfDemand[0] ) );
+    if ( NULL == cellOfDemand )
+    {
+        fprintf( stderr, "failed to allocate memory for DemandIndex\n" );
+        exit( 1 );
+    }
+
+    // 1st pass counts the demands of each geohash6, and remembers the geohash6 of 
+    // each demand so that it is not looked up again
+
+    for ( i = 0; i < buf->nrDemand; i++ )
+    {
+        hashItem = insertDemandInGeohash6( index->cell, &( buf->d[i] ), 1 );
+        cellOfDemand[i] = hashItem - index->cell->item;
+    }
+
+    nrGeohash6 = index->cell->nrGeohash6;
+
+    index->offset = malloc( ( nrGeohash6 + 1 ) * sizeof( index->offset[0] ) );
+    index->hashkey = malloc( ( nrGeohash6 + 1 ) * sizeof( index->hashkey[0] ) );
+    index->geohash6 = malloc( ( nrGeohash6 + 1 ) * sizeof( index->geohash6[0] ) );
+    index->id = malloc( ( nrGeohash6 + 1 ) * sizeof( index->id[0] ) );
+    index->d = malloc( ( buf->nrDemand + 1 ) * sizeof( index->d[0] ) );
+    tmp = malloc( ( buf->nrDemand + 1 ) * sizeof( tmp[0] ) );
+    sorted = malloc( ( nrGeohash6 + 1 ) * sizeof( sorted[0] ) );
+    nrFilled = calloc( nrGeohash6 + 1, sizeof( nrFilled[0] ) );
+    if ( NULL == nrFilled
+         || NULL == index->offset
+         || NULL == index->hashkey
+         || NULL == index->geohash6
+         || NULL == index->id
+         || NULL == index->d
+         || NULL == tmp
+         || NULL == sorted )
+    {
+        fprintf( stderr, "failed to allocate memory for DemandIndex\n" );
+        exit( 1 );
+    }
+
+    for ( i = 0; i < nrGeohash6; i++ )
+    {
+        index->offset[i] = nrDemand;
+        nrDemand += index->cell->item[i].nrDemand;
+    }
+
+    index->offset[nrGeohash6] = nrDemand;
+
+    // 2nd pass fills the demands at the offsets of their geohash6, and then the 
+    // demands of each geohash6 are sorted by time by the threads, each geohash6 
+    // uses tmp at its own offset
+
+    for ( i = 0; i < buf->nrDemand; i++ )
+    {
+        id = cellOfDemand[i];
+
+        index->d[index->offset[id] + getPositionInGeohash6( nrFilled[id]++, index->cell->item[id].nrDemand )] = &( buf->d[i] );
+    }
+
+    sort.index = index;
+    sort.tmp = tmp;
+    sort.next = 0;
+
+    nrThread = ( nrThread < nrGeohash6 ) ? nrThread : nrGeohash6;
+
+    for ( i = 1; i < nrThread; i++ )
+    {
+        ret = pthread_create( &thread[i], NULL, sortDemandIndexThread, &sort );
+        if ( 0 != ret )
+        {
+            fprintf( stderr, "failed to create thread: %s\n", strerror( ret ) );
+            exit( 1 );
+        }
+    }
+
+    sortDemandIndexThread( &sort );
+
+    for ( i = 1; i < nrThread; i++ )
+    {
+        pthread_join( thread[i], NULL );
+    }
+
+    for ( i = 0; i < nrGeohash6; i++ )
+    {
+        hashItem = &( index->cell->item[i] );
+
+        index->hashkey[i] = getHashValueOfString( decodeGeohash6( hashItem->geohash6, geohash6 ) );
+
+        sorted[i].geohash6 = hashItem->geohash6;
+        sorted[i].id = i;
+    }
+
+    qsort( sorted, nrGeohash6, sizeof( sorted[0] ), compareDemandInGeohash6Slot );
+
+    for ( i = 0; i < nrGeohash6; i++ )
+    {
+        index->geohash6[i] = sorted[i].geohash6;
+        index->id[i] = sorted[i].id;
+    }
+
+    free( sorted );
+    free( tmp );
+    free( nrFilled );
+    free( cellOfDemand );
+
+    return index;
+}
+
+
+void
+deleteDemandIndex( DemandIndex * index )
+{
+    deleteDemandInGeohash6( index->cell );
+
+    free( index->offset );
+    free( index->hashkey );
+    free( index->geohash6 );
+    free( index->id );
+    free( index->d );
+    free( index );
+}
+
+
+/* the function fills order with the cells of index that have demands matching filter 
+ * and returns the number of them. The cells are ordered as the chained hash buckets of 
+ * geohash6 printed them when the matching demands were inserted as they were read, after 
+ * the geohash6 values listed in the query, so the output is the same as reading the demands 
+ * with the filter.
+ */
+static long
+selectDemandIndex( DemandIndex * index, DemandFilter * filter, DemandInGeohash6Table * listed, DemandInGeohash6Order * order )
+{
+    DemandInGeohash6 * hashItem;
+    char             * isMatched;
+    long               nrGeohash6 = index->cell->nrGeohash6;
+    long               nrOrder = 0;
+    long               first;
+    long               id;
+    long               i;
+    long               j;
+
+
+    isMatched = malloc( nrGeohash6 + 1 );
+    if ( NULL == isMatched )
+    {
+        fprintf( stderr, "failed to allocate memory for more geohash6 flags\n" );
+        exit( 1 );
+    }
+
+    markGeohash6InFilter( filter, index->geohash6, nrGeohash6, isMatched );
+
+    for ( i = 0; i < nrGeohash6; i++ )
+    {
+        if ( ! isMatched[i] )
+        {
+            continue;
+        }
+
+        id = index->id[i];
+
+        // a geohash6 is inserted when its first matching demand is read
+
+        first = -1;
+        for ( j = index->offset[id]; j < index->offset[id + 1]; j++ )
+        {
+            if ( isDemandInTimeFilter( filter, index->d[j] )
+                 && ( first < 0 
+                      || index->d[j] - index->buf->d < first ) )
+            {
+                first = index->d[j] - index->buf->d;
+            }
+        }
+
+        if ( first < 0 )
+        {
+            continue;
+        }
+
+        hashItem = ( NULL == listed ) ? NULL : insertGeohash6( listed, index->geohash6[i], 0 );
+
+        order[nrOrder].hashkey = index->hashkey[id];
+        order[nrOrder].rank = ( NULL != hashItem ) ? hashItem - listed->item : first + ( NULL == listed ? 0 : listed->nrGeohash6 );
+        order[nrOrder].id = id;
+        nrOrder++;
+    }
+
+    qsort( order, nrOrder, sizeof( order[0] ), compareDemandInGeohash6Order );
+
+    free( isMatched );
+
+    return nrOrder;
+}
+
+
+/* the function calls function for each demand of index matching filter, in the order they 
+ * are printed, by geohash6 and then by time.
+ */
+void
+forEachDemandInIndex( DemandIndex * index, DemandFilter * filter, DemandInGeohash6Table * listed, DemandFunction function, void * arg )
+{
+    DemandInGeohash6Order * order;
+    long                    nrOrder;
+    long                    i;
+    long                    j;
+
+
+    order = malloc( ( index->cell->nrGeohash6 + 1 ) * sizeof( order[0] ) );
+    if ( NULL == order )
+    {
+        fprintf( stderr, "failed to allocate memory for more DemandInGeohash6Order\n" );
+        exit( 1 );
+    }
+
+    nrOrder = selectDemandIndex( index, filter, listed, order );
+
+    for ( i = 0; i < nrOrder; i++ )
+    {
+        for ( j = index->offset[order[i].id]; j < index->offset[order[i].id + 1]; j++ )
+        {
+            if ( isDemandInTimeFilter( filter, index->d[j] ) )
+            {
+                function( index->d[j], arg );
+            }
+        }
+    }
+
+    free( order );
+}
+
+
+static void
+printDemandToStream( Demand * d, void * arg )
+{
+    printDemand( arg, d );
+}
+
+
+static void
+printDemandOfCell( FILE * out, DemandIndex * index, long cell, void * arg )
+{
+    DemandFilter * filter = arg;
+    long           j;
+
+
+    for ( j = index->offset[cell]; j < index->offset[cell + 1]; j++ )
+    {
+        if ( isDemandInTimeFilter( filter, index->d[j] ) )
+        {
+            printDemand( out, index->d[j] );
+        }
+    }
+}
+
+
+/* the function prints the demands of index matching filter in the same order as 
+ * forEachDemandInIndex, the geohash6 values are formatted by DemandTask on nrThread 
+ * threads and written out in order.
+ */
+void
+printDemandIndex( FILE * out, DemandIndex * index, DemandFilter * filter, DemandInGeohash6Table * listed, int nrThread )
+{
+    DemandInGeohash6Order * order;
+    long                  * cell;
+    long                    nrOrder;
+    long                    i;
+
+
+    order = malloc( ( index->cell->nrGeohash6 + 1 ) * sizeof( order[0] ) );
+    cell = malloc( ( index->cell->nrGeohash6 + 1 ) * sizeof( cell[0] ) );
+    if ( NULL == order 
+         || NULL == cell )
+    {
+        fprintf( stderr, "failed to allocate memory for more DemandInGeohash6Order\n" );
+        exit( 1 );
+    }
+
+    nrOrder = selectDemandIndex( index, filter, listed, order );
+
+    for ( i = 0; i < nrOrder; i++ )
+    {
+        cell[i] = order[i].id;
+    }
+
+    runDemandTaskInOrder( out, index, cell, nrOrder, printDemandOfCell, filter, nrThread );
+
+    free( cell );
+    free( order );
+}
+
+
+/* the function processes the demands of index matching the filter of query, they are 
+ * processed in the order they were read so that sums are the same as reading them.
+ */
+void
+processDemandIndexInQuery( DemandQuery * query, DemandIndex * index )
+{
+    DemandInGeohash6Order * order;
+    Demand              * * dptr;
+    long                    nrOrder;
+    long                    nrDemand = 0;
+    long                    i;
+    long                    j;
+
+
+    order = malloc( ( index->cell->nrGeohash6 + 1 ) * sizeof( order[0] ) );
+    if ( NULL == order )
+    {
+        fprintf( stderr, "failed to allocate memory for more DemandInGeohash6Order\n" );
+        exit( 1 );
+    }
+
+    nrOrder = selectDemandIndex( index, &( query->filter ), NULL, order );
+
+    for ( i = 0; i < nrOrder; i++ )
+    {
+        nrDemand += index->offset[order[i].id + 1] - index->offset[order[i].id];
+    }
+
+    dptr = malloc( ( nrDemand + 1 ) * sizeof( dptr[0] ) );
+    if ( NULL == dptr )
+    {
+        fprintf( stderr, "failed to allocate memory for more Demand *\n" );
+        exit( 1 );
+    }
+
+    nrDemand = 0;
+    for ( i = 0; i < nrOrder; i++ )
+    {
+        for ( j = index->offset[order[i].id]; j < index->offset[order[i].id + 1]; j++ )
+        {
+            if ( isDemandInTimeFilter( &( query->filter ), index->d[j] ) )
+            {
+                dptr[nrDemand++] = index->d[j];
+            }
+        }
+    }
+
+    qsort( dptr, nrDemand, sizeof( dptr[0] ), compareDemandPosition );
+
+    for ( i = 0; i < nrDemand; i++ )
+    {
+        processDemandInQuery( query, dptr[i] );
+    }
+
+    free( dptr );
+    free( order );
+}
+
+
+/* the function answers a query line of -g, -b, -d, -t, -a and -k options from index, 
+ * onDemand is called for each matching demand, or onGroup for each group of the aggregates 
+ * with -a, in the order the command line prints them. line is changed by the parsing, and 
+ * -1 is returned with the error message in err when it is not valid. Queries do not change 
+ * index, so any number of them are answered by their own threads at the same time.
+ */
+int
+queryDemandIndex( DemandIndex * index, char * line, DemandFunction onDemand, DemandInGroupFunction onGroup, void * arg, char * err )
+{
+    DemandQuery             query;
+    DemandInGeohash6Table * listed;
+    int                     ret;
+
+
+    memset( &query, 0, sizeof( query ) );
+    initDemandFilter( &( query.filter ) );
+    listed = newDemandInGeohash6();
+
+    ret = parseDemandQuery( &query, line, listed, err );
+    if ( 0 == ret
+         && NULL != query.agg )
+    {
+        processDemandIndexInQuery( &query, index );
+        forEachDemandInGroup( query.agg, onGroup, arg );
+    }
+    else if ( 0 == ret )
+    {
+        forEachDemandInIndex( index, &( query.filter ), listed, onDemand, arg );
+    }
+
+    if ( NULL != query.agg )
+    {
+        deleteDemandAggregate( query.agg );
+    }
+
+    deleteDemandInGeohash6( listed );
+    free( query.filter.geohash6 );
+    free( query.filter.isPrefixAny );
+
+    return ret;
+}
+
+
+size_t
+getSizeOfDemandIndex( DemandIndex * index )
+{
+    long nrGeohash6 = index->cell->nrGeohash6;
+
+
+    return sizeof( DemandIndex ) 
+           + sizeof( DemandInGeohash6Table )
+           + index->cell->maxGeohash6 * sizeof( index->cell->item[0] )
+           + index->cell->nrSlot * sizeof( index->cell->slot[0] )
+           + ( nrGeohash6 + 1 ) * ( sizeof( index->offset[0] ) + sizeof( index->hashkey[0] ) + sizeof( index->geohash6[0] ) + sizeof( index->id[0] ) )
+           + ( index->offset[nrGeohash6] + 1 ) * sizeof( index->d[0] );
+}
+
+
+/* the function returns the last min interval of the year of all demands, or -1 when there 
+ * is no demand. The demands of each cell are sorted by time, so only the last one of each 
+ * cell is looked at.
+ */
+long
+getLastMinIntervalOfDemandIndex( DemandIndex * index )
+{
+    long last = -1;
+    long minInterval;
+    long i;
+
+
+    for ( i = 0; i < index->cell->nrGeohash6; i++ )
+    {
+        if ( index->offset[i + 1] > index->offset[i] )
+        {
+            minInterval = getMinIntervalOfYear( index->d[index->offset[i + 1] - 1] );
+            last = ( minInterval > last ) ? minInterval : last;
+        }
+    }
+
+    return last;
+}
+
+/* End of DemandIndex API */
+
+
+/* Start of DemandDataset API */
+
+/* the function reads the files of path, or standard input when nrPath is 0, with nrThread 
+ * threads and keeps the demands matching the -g, -b, -d and -t options of line, all of 
+ * them when line is NULL. It returns NULL with the error message in err when line is not 
+ * valid or a file can not be opened.
+ */
+DemandDataset *
+loadDemandDataset( char * * path, int nrPath, char * line, int nrThread, char * err )
+{
+    DemandDataset         * dataset;
+    DemandInGeohash6Table * listed;
+    FILE              * * file;
+    int                     nrFile = ( nrPath > 0 ) ? nrPath : 1;
+    int                     nrOpen;
+    int                     ret = 0;
+    int                     i;
+
+
+    dataset = calloc( 1, sizeof( DemandDataset ) );
+    file = malloc( nrFile * sizeof( file[0] ) );
+    if ( NULL == dataset
+         || NULL == file )
+    {
+        fprintf( stderr, "failed to allocate memory for more DemandDataset\n" );
+        exit( 1 );
+    }
+
+    initDemandFilter( &( dataset->load.filter ) );
+
+    if ( NULL != line )
+    {
+        listed = newDemandInGeohash6();
+        ret = parseDemandQuery( &( dataset->load ), line, listed, err );
+        deleteDemandInGeohash6( listed );
+
+        if ( 0 == ret
+             && NULL != dataset->load.agg )
+        {
+            snprintf( err, MAX_ERROR_LEN, "-a and -k are given to a query of the dataset, not when it is loaded" );
+            ret = -1;
+        }
+    }
+    else
+    {
+        compileDemandFilter( &( dataset->load.filter ) );
+    }
+
+    nrThread = ( nrThread < 1 ) ? 1 : ( nrThread > MAX_NUM_THREAD ) ? MAX_NUM_THREAD : nrThread;
+
+    file[0] = stdin;
+
+    for ( nrOpen = 0; 0 == ret && nrOpen < nrPath; nrOpen++ )
+    {
+        file[nrOpen] = fopen( path[nrOpen], "r" );
+        if ( NULL == file[nrOpen] )
+        {
+            snprintf( err, MAX_ERROR_LEN, "open file error: %s", path[nrOpen] );
+            ret = -1;
+            break;
+        }
+    }
+
+    if ( 0 == ret )
+    {
+        ret = readDemand( &( dataset->load ), file, nrFile, nrThread, err );
+    }
+
+    if ( 0 == ret )
+    {
+        dataset->index = newDemandIndex( &( dataset->load.result ), nrThread );
+    }
+
+    for ( i = 0; i < nrOpen; i++ )
+    {
+        fclose( file[i] );
+    }
+
+    free( file );
+
+    if ( ret < 0 )
+    {
+        deleteDemandDataset( dataset );
+        dataset = NULL;
+    }
+
+    return dataset;
+}
+
+
+void
+deleteDemandDataset( DemandDataset * dataset )
+{
+    if ( NULL != dataset->index )
+    {
+        deleteDemandIndex( dataset->index );
+    }
+
+    if ( NULL != dataset->load.agg )
+    {
+        deleteDemandAggregate( dataset->load.agg );
+    }
+
+    free( dataset->load.filter.geohash6 );
+    free( dataset->load.filter.isPrefixAny );
+    free( dataset->load.result.d );
+    free( dataset );
+}
+
+
+/* the function answers a query line of -g, -b, -d, -t, -a and -k options like the server, 
+ * see queryDemandIndex.
+ */
+int
+queryDemandDataset( DemandDataset * dataset, char * line, DemandFunction onDemand, DemandInGroupFunction onGroup, void * arg, char * err )
+{
+    return queryDemandIndex( dataset->index, line, onDemand, onGroup, arg, err );
+}
+
+/* End of DemandDataset API */
+
+
+/* Start of DemandServer API */
+
+typedef struct demandconnection DemandConnection;
+
+struct demandconnection
+{
+    DemandIndex * index;
+    int           fd;
+};
+
+
+static void *
+serveDemandConnection( void * arg )
+{
+    DemandConnection * conn = arg;
+    FILE             * in;
+    FILE             * out;
+    char             * line = NULL;
+    size_t             size = 0;
+    char               err[MAX_ERROR_LEN];
+    int                fd;
+
+
+    fd = dup( conn->fd );
+    in = fdopen( conn->fd, "r" );
+    out = ( fd < 0 ) ? NULL : fdopen( fd, "w" );
+    // a connection that can not be opened is closed, and the server keeps answering 
+    // the others
+
+    if ( NULL == in 
+         || NULL == out )
+    {
+        fprintf( stderr, "failed to open connection: %s\n", strerror( errno ) );
+
+        if ( NULL != in )
+        {
+            fclose( in );
+        }
+        else
+        {
+            close( conn->fd );
+        }
+
+        if ( NULL != out )
+        {
+            fclose( out );
+        }
+        else if ( fd >= 0 )
+        {
+            close( fd );
+        }
+
+        free( conn );
+
+        return NULL;
+    }
+
+    while ( getline( &line, &size, in ) != -1 )
+    {
+        if ( queryDemandIndex( conn->index, line, printDemandToStream, printDemandInGroupToStream, out, err ) < 0 )
+        {
+            fprintf( out, "error: %s\n", err );
+        }
+
+        // an empty line ends the response, the client may have gone away
+
+        fprintf( out, "\n" );
+        if ( fflush( out ) != 0 )
+        {
+            break;
+        }
+    }
+
+    free( line );
+    fclose( out );
+    fclose( in );
+    free( conn );
+
+    return NULL;
+}
+
+
+void
+serveDemandIndex( char * path, DemandIndex * index )
+{
+    struct sockaddr_un addr;
+    struct stat        st;
+    DemandConnection * conn;
+    pthread_t          thread;
+    int                fd;
+    int                ret;
+
+
+    if ( strlen( path ) >= sizeof( addr.sun_path ) )
+    {
+        fprintf( stderr, "socket path is too long: %s\n", path );
+        exit( 1 );
+    }
+
+    memset( &addr, 0, sizeof( addr ) );
+    addr.sun_family = AF_UNIX;
+    strcpy( addr.sun_path, path );
+
+    // a socket left by a server that is gone is replaced, but not any other file
+
+    if ( lstat( path, &st ) == 0
+         && S_ISSOCK( st.st_mode ) )
+    {
+        unlink( path );
+    }
+
+    fd = socket( AF_UNIX, SOCK_STREAM, 0 );
+    if ( fd < 0 
+         || bind( fd, ( struct sockaddr * ) &addr, sizeof( addr ) ) < 0
+         || listen( fd, SOMAXCONN ) < 0 )
+    {
+        fprintf( stderr, "failed to listen on %s: %s\n", path, strerror( errno ) );
+        exit( 1 );
+    }
+
+    // a client that goes away is noticed by the failed write, not by a signal
+
+    signal( SIGPIPE, SIG_IGN );
+
+    while ( 1 )
+    {
+        conn = malloc( sizeof( DemandConnection ) );
+        if ( NULL == conn )
+        {
+            fprintf( stderr, "failed to allocate memory for DemandConnection\n" );
+            exit( 1 );
+        }
+
+        conn->index = index;
+        conn->fd = accept( fd, NULL, NULL );
+        if ( conn->fd < 0 )
+        {
+            free( conn );
+
+            if ( EINTR == errno 
+                 || ECONNABORTED == errno )
+            {
+                continue;
+            }
+
+            fprintf( stderr, "failed to accept connection on %s: %s\n", path, strerror( errno ) );
+            exit( 1 );
+        }
+
+        ret = pthread_create( &thread, NULL, serveDemandConnection, conn );
+        if ( ret != 0 )
+        {
+            fprintf( stderr, "failed to create thread: %s\n", strerror( ret ) );
+            exit( 1 );
+        }
+
+        pthread_detach( thread );
+    }
+}
+
+
+/* the function sends line to the server, prints the response and returns the exit 
+ * status of the program, 1 when the server answers with an error.
+ */
+int
+queryDemandServer( char * path, char * line )
+{
+    struct sockaddr_un addr;
+    FILE             * file;
+    char             * response = NULL;
+    size_t             size = 0;
+    int                ret = -1;
+    int                fd;
+
+
+    if ( strlen( path ) >= sizeof( addr.sun_path ) )
+    {
+        fprintf( stderr, "socket path is too long: %s\n", path );
+        exit( 1 );
+    }
+
+    memset( &addr, 0, sizeof( addr ) );
+    addr.sun_family = AF_UNIX;
+    strcpy( addr.sun_path, path );
+
+    // a connection that the server closes is reported rather than ending the client
+
+    signal( SIGPIPE, SIG_IGN );
+
+    fd = socket( AF_UNIX, SOCK_STREAM, 0 );
+    if ( fd < 0 
+         || connect( fd, ( struct sockaddr * ) &addr, sizeof( addr ) ) < 0
+         || NULL == ( file = fdopen( fd, "r+" ) ) )
+    {
+        fprintf( stderr, "failed to connect to %s: %s\n", path, strerror( errno ) );
+        exit( 1 );
+    }
+
+    if ( fprintf( file, "%s\n", line ) < 0
+         || fflush( file ) != 0 )
+    {
+        fprintf( stderr, "failed to send query to %s: %s\n", path, strerror( errno ) );
+        exit( 1 );
+    }
+
+    while ( getline( &response, &size, file ) != -1 )
+    {
+        if ( strcmp( response, "\n" ) == 0 )
+        {
+            ret = ( ret < 0 ) ? 0 : ret;
+            break;
+        }
+        else if ( strncmp( response, "error: ", 7 ) == 0 )
+        {
+            fputs( response + 7, stderr );
+            ret = 1;
+        }
+        else
+        {
+            fputs( response, stdout );
+        }
+    }
+
+    if ( ret < 0 )
+    {
+        fprintf( stderr, "connection to %s is closed before the response ends\n", path );
+        ret = 1;
+    }
+
+    free( response );
+    fclose( file );
+
+    return ret;
+}
+
+
+char *
+appendDemandQueryLine( char * line, int opt, char * arg )
+{
+    size_t len = ( NULL == line ) ? 0 : strlen( line );
+
+
+    // a space, -, the option, arg and '\0'
+
+    line = realloc( line, len + strlen( arg ) + 4 );
+    if ( NULL == line )
+    {
+        fprintf( stderr, "no memory\n" );
+        exit( 1 );
+    }
+
+    sprintf( line + len, " -%c%s", opt, arg );
+
+    return line;
+}
+
+/* End of DemandServer API */
+
+
+/* Start of DemandStats API */
+
+static void
+getDemandTime( double * wall, double * cpu )
+{
+    struct timespec ts;
+
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    *wall = ts.tv_sec + ts.tv_nsec / 1e9;
+
+    clock_gettime( CLOCK_PROCESS_CPUTIME_ID, &ts );
+    *cpu = ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+void
+startDemandPhase( DemandStats * stats, const char * name )
+{
+    DemandPhase * phase;
+    double        wall;
+    double        cpu;
+
+
+    assert( stats->nrPhase < MAX_NUM_PHASE );
+
+    getDemandTime( &wall, &cpu );
+
+    phase = &( stats->phase[stats->nrPhase++] );
+    phase->name = name;
+    phase->wall = -wall;
+    phase->cpu = -cpu;
+}
+
+
+void
+endDemandPhase( DemandStats * stats )
+{
+    DemandPhase * phase = &( stats->phase[stats->nrPhase - 1] );
+    double        wall;
+    double        cpu;
+
+
+    getDemandTime( &wall, &cpu );
+
+    phase->wall += wall;
+    phase->cpu += cpu;
+}
+
+
+void
+statDemandIndex( DemandStats * stats, DemandIndex * index )
+{
+    stats->nrGeohash6 = index->cell->nrGeohash6;
+    stats->nrSlot = index->cell->nrSlot;
+    stats->longestProbe = getLongestProbeOfDemandInGeohash6( index->cell );
+    stats->indexSize = getSizeOfDemandIndex( index );
+}
+
+
+void
+statDemandAggregate( DemandStats * stats, DemandAggregate * agg )
+{
+    stats->nrGroup = agg->nrGroup;
+    stats->nrBucket = agg->nrBucket;
+    stats->longestChain = getLongestChainOfDemandAggregate( agg );
+}
+
+
+void
+printDemandStats( FILE * out, DemandStats * stats, int isJson )
+{
+    struct rusage usage;
+    int           i;
+
+
+    // ru_maxrss is in kilobytes on Linux
+
+    getrusage( RUSAGE_SELF, &usage );
+
+    if ( isJson )
+    {
+        fprintf( out, "{\"phases\":[" );
+        for ( i = 0; i < stats->nrPhase; i++ )
+        {
+            fprintf( out, "%s{\"name\":\"%s\",\"wallMs\":%.3f,\"cpuMs\":%.3f}",
+                     i > 0 ? "," : "",
+                     stats->phase[i].name, 
+                     stats->phase[i].wall * 1000.0, 
+                     stats->phase[i].cpu * 1000.0 );
+        }
+
+        fprintf( out, "],\"rows\":{\"read\":%ld,\"rejected\":%ld,\"matched\":%ld}", 
+                 stats->nrRead, stats->nrRejected, stats->nrMatched );
+        fprintf( out, ",\"geohash6Table\":{\"geohash6\":%ld,\"slots\":%ld,\"longestProbe\":%ld}", 
+                 stats->nrGeohash6, stats->nrSlot, stats->longestProbe );
+        fprintf( out, ",\"aggregate\":{\"groups\":%ld,\"buckets\":%ld,\"longestChain\":%ld}", 
+                 stats->nrGroup, stats->nrBucket, stats->longestChain );
+        fprintf( out, ",\"memory\":{\"demandBytes\":%lu,\"indexBytes\":%lu,\"peakRssKb\":%ld}}\n", 
+                 ( unsigned long ) stats->bufferSize, ( unsigned long ) stats->indexSize, ( long ) usage.ru_maxrss );
+    }
+    else
+    {
+        fprintf( out, "%-16s %12s %12s\n", "phase", "wall ms", "cpu ms" );
+        for ( i = 0; i < stats->nrPhase; i++ )
+        {
+            fprintf( out, "%-16s %12.3f %12.3f\n", stats->phase[i].name, stats->phase[i].wall * 1000.0, stats->phase[i].cpu * 1000.0 );
+        }
+
+        fprintf( out, "rows             read %ld, rejected %ld, matched %ld\n", stats->nrRead, stats->nrRejected, stats->nrMatched );
+
+        if ( stats->nrSlot > 0 )
+        {
+            fprintf( out, "geohash6 table   %ld geohash6 in %ld slots, load factor %.2f, longest probe %ld\n",
+                     stats->nrGeohash6, stats->nrSlot, ( double ) stats->nrGeohash6 / stats->nrSlot, stats->longestProbe );
+        }
+
+        if ( stats->nrBucket > 0 )
+        {
+            fprintf( out, "aggregate        %ld groups in %ld buckets, load factor %.2f, longest chain %ld\n",
+                     stats->nrGroup, stats->nrBucket, ( double ) stats->nrGroup / stats->nrBucket, stats->longestChain );
+        }
+
+        fprintf( out, "memory           demands %lu bytes, index %lu bytes, peak RSS %ld KB\n", 
+                 ( unsigned long ) stats->bufferSize, ( unsigned long ) stats->indexSize, ( long ) usage.ru_maxrss );
+    }
+}
+
+/* End of DemandStats API */
+
+
+/* Start of DemandTask API */
+
+typedef struct demandtask DemandTask;
+
+struct demandtask
+{
+    DemandIndex        * index;
+    DemandTaskFunction   function;
+    void               * arg;
+    long               * cell;        // cells in the order of the output
+    long                 begin;       // block of the cells
+    long                 end;
+    long                 next;        // next cell of the block, taken by the threads
+    char             * * output;      // memory stream of each cell of the block
+    size_t             * outputSize;
+};
+
+
+static void *
+runDemandTaskThread( void * arg )
+{
+    DemandTask * task = arg;
+    FILE       * out;
+    long         i;
+
+
+    while ( ( i = __sync_fetch_and_add( &( task->next ), 1 ) ) < task->end )
+    {
+        out = open_memstream( &( task->output[i - task->begin] ), &( task->outputSize[i - task->begin] ) );
+        if ( NULL == out )
+        {
+            fprintf( stderr, "failed to open memory stream: %s\n", strerror( errno ) );
+            exit( 1 );
+        }
+
+        task->function( out, task->index, task->cell[i], task->arg );
+
+        fclose( out );
+    }
+
+    return NULL;
+}
+
+
+/* the function writes the memory streams of the block of task to out in order, by writev 
+ * of up to MAX_NUM_IOVEC streams after flushing out when it is a file, or by fwrite when 
+ * it is not.
+ */
+static void
+writeDemandTaskOutput( FILE * out, DemandTask * task )
+{
+    struct iovec iov[MAX_NUM_IOVEC];
+    long         nrOutput = task->end - task->begin;
+    long         i;
+    long         j;
+    int          nrIov;
+    int          first;
+    ssize_t      n;
+    int          fd;
+
+
+    fflush( out );
+    fd = fileno( out );
+
+    for ( i = 0; fd < 0 && i < nrOutput; i++ )
+    {
+        fwrite( task->output[i], 1, task->outputSize[i], out );
+    }
+
+    for ( i = 0; fd >= 0 && i < nrOutput; i = j )
+    {
+        for ( nrIov = 0, j = i; j < nrOutput && nrIov < MAX_NUM_IOVEC; j++ )
+        {
+            if ( task->outputSize[j] > 0 )
+            {
+                iov[nrIov].iov_base = task->output[j];
+                iov[nrIov].iov_len = task->outputSize[j];
+                nrIov++;
+            }
+        }
+
+        // a partial write continues from the first byte that is not written
+
+        for ( first = 0; first < nrIov; )
+        {
+            n = writev( fd, iov + first, nrIov - first );
+            if ( n < 0 )
+            {
+                if ( EINTR == errno )
+                {
+                    continue;
+                }
+
+                fprintf( stderr, "failed to write output: %s\n", strerror( errno ) );
+                exit( 1 );
+            }
+
+            for ( ; first < nrIov && ( size_t ) n >= iov[first].iov_len; first++ )
+            {
+                n -= iov[first].iov_len;
+            }
+
+            if ( first < nrIov )
+            {
+                iov[first].iov_base = ( char * ) iov[first].iov_base + n;
+                iov[first].iov_len -= n;
+            }
+        }
+    }
+
+    for ( i = 0; i < nrOutput; i++ )
+    {
+        free( task->output[i] );
+    }
+}
+
+
+void
+runDemandTask( FILE * out, DemandIndex * index, DemandTaskFunction function, void * arg, int nrThread )
+{
+    runDemandTaskInOrder( out, index, index->id, index->cell->nrGeohash6, function, arg, nrThread );
+}
+
+
+void
+runDemandTaskInOrder( FILE * out, DemandIndex * index, long * cell, long nrCell, DemandTaskFunction function, void * arg, int nrThread )
+{
+    DemandTask task;
+    pthread_t  thread[MAX_NUM_THREAD];
+    long       nrTaskInBlock = ( long ) nrThread * NUM_TASK_PER_THREAD;
+    long       i;
+    int        ret;
+
+
+    task.index = index;
+    task.function = function;
+    task.arg = arg;
+    task.cell = cell;
+    task.output = malloc( nrTaskInBlock * sizeof( task.output[0] ) );
+    task.outputSize = malloc( nrTaskInBlock * sizeof( task.outputSize[0] ) );
+    if ( NULL == task.output
+         || NULL == task.outputSize )
+    {
+        fprintf( stderr, "failed to allocate memory for DemandTask\n" );
+        exit( 1 );
+    }
+
+    for ( task.begin = 0; task.begin < nrCell; task.begin = task.end )
+    {
+        task.end = ( task.begin + nrTaskInBlock < nrCell ) ? task.begin + nrTaskInBlock : nrCell;
+        task.next = task.begin;
+
+        for ( i = 1; i < nrThread; i++ )
+        {
+            ret = pthread_create( &thread[i], NULL, runDemandTaskThread, &task );
+            if ( 0 != ret )
+            {
+                fprintf( stderr, "failed to create thread: %s\n", strerror( ret ) );
+                exit( 1 );
+            }
+        }
+
+        runDemandTaskThread( &task );
+
+        for ( i = 1; i < nrThread; i++ )
+        {
+            pthread_join( thread[i], NULL );
+        }
+
+        writeDemandTaskOutput( out, &task );
+    }
+
+    free( task.output );
+    free( task.outputSize );
+}
+
+/* End of DemandTask API */
+
+
+/* Start of DemandFeature API */
+
+/* the function parses a list of lags or windows like 1..4,96 into list, and returns the 
+ * number of them, or -1 when it is not valid.
+ */
+int
+parseFeatureList( char * s, int * list )
+{
+    int    from;
+    int    to;
+    int    nrList = 0;
+    int    ret;
+    char * save;
+
+
+    for ( ret = parseRange( s, &from, &to, &save ); ret > 0; ret = parseRange( NULL, &from, &to, &save ) )
+    {
+        if ( from <= 0
+             || from > to
+             || to >= MININTERVALS_IN_YEAR 
+             || nrList + to - from + 1 > MAX_NUM_FEATURE )
+        {
+            return -1;
+        }
+
+        for ( ; from <= to; from++ )
+        {
+            list[nrList++] = from;
+        }
+    }
+
+    return ( ret < 0 ) ? -1 : nrList;
+}
+
+
+void
+printDemandFeatureHeader( FILE * out, DemandFeatureSpec * spec )
+{
+    int i;
+
+
+    fprintf( out, "geohash6,day,timestamp,demand" );
+
+    for ( i = 0; i < spec->nrLag; i++ )
+    {
+        fprintf( out, ",lag%d", spec->lag[i] );
+    }
+
+    for ( i = 0; i < spec->nrWindow; i++ )
+    {
+        fprintf( out, ",sum%d,mean%d", spec->window[i], spec->window[i] );
+    }
+
+    fprintf( out, "\n" );
+}
+
+
+/* the function prints the features of the demands of a cell of index, arg is the 
+ * DemandFeatureSpec. The demands of the same min interval are added up.
+ */
+void
+printDemandFeatureOfGeohash6( FILE * out, DemandIndex * index, long cell, void * arg )
+{
+    DemandFeatureSpec * spec = arg;
+    Demand          * * dptr = index->d + index->offset[cell];
+    long                nrDemand = index->offset[cell + 1] - index->offset[cell];
+    Demand            * d;
+    double            * ring;
+    double              sum[MAX_NUM_FEATURE] = { 0.0 };
+    long                nrNonZero[MAX_NUM_FEATURE] = { 0 };
+    double              value;
+    double              leaving;
+    long                nrRing = spec->span + 1;
+    long                first;
+    long                t;
+    long                j;
+    int                 i;
+    char                geohash6[GEOHASH6_LEN + 1];
+    char                buf[MAX_VALUE_LEN];
+
+
+    if ( 0 == nrDemand )
+    {
+        return;
+    }
+
+    ring = calloc( nrRing, sizeof( ring[0] ) );
+    if ( NULL == ring )
+    {
+        fprintf( stderr, "failed to allocate memory for DemandFeature\n" );
+        exit( 1 );
+    }
+
+    decodeGeohash6( dptr[0]->geohash6, geohash6 );
+
+    first = getMinIntervalOfYear( dptr[0] );
+
+    for ( t = first, j = 0; j < nrDemand; t++ )
+    {
+        d = NULL;
+        value = 0.0;
+
+        while ( j < nrDemand 
+                && getMinIntervalOfYear( dptr[j] ) == t )
+        {
+            d = dptr[j++];
+            value += d->value;
+        }
+
+        // the sums of windows are of the min intervals before t here
+
+        if ( NULL != d )
+        {
+            fprintf( out, "%s,%02d,%02d:%02d,%s", geohash6, d->day, d->hh, d->mm, formatDemandValue( value, buf ) );
+
+            for ( i = 0; i < spec->nrLag; i++ )
+            {
+                fprintf( out, ",%s", formatDemandValue( t - spec->lag[i] >= first ? ring[( t - spec->lag[i] ) % nrRing] : 0.0, buf ) );
+            }
+
+            for ( i = 0; i < spec->nrWindow; i++ )
+            {
+                fprintf( out, ",%s", formatDemandValue( sum[i], buf ) );
+                fprintf( out, ",%s", formatDemandValue( sum[i] / spec->window[i], buf ) );
+            }
+
+            fprintf( out, "\n" );
+        }
+
+        // the demand of t enters the windows and the demand of t - window leaves them, 
+        // a window without demand is set to 0 so that rounding errors do not stay
+
+        for ( i = 0; i < spec->nrWindow; i++ )
+        {
+            leaving = ( t - spec->window[i] >= first ) ? ring[( t - spec->window[i] ) % nrRing] : 0.0;
+
+            sum[i] += value - leaving;
+            nrNonZero[i] += ( 0.0 != value ) - ( 0.0 != leaving );
+
+            if ( 0 == nrNonZero[i] )
+            {
+                sum[i] = 0.0;
+            }
+        }
+
+        ring[t % nrRing] = value;
+    }
+
+    free( ring );
+}
+
+/* End of DemandFeature API */
+
+
+/* Start of DemandForecast API */
+
+int
+parseForecastModel( char * s )
+{
+    static char * names[NUM_FORECAST] = { "naive", "smooth", "linear" };
+    int           i;
+
+
+    for ( i = 0; i < NUM_FORECAST; i++ )
+    {
+        if ( strcmp( s, names[i] ) == 0 )
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+
+/* the function forecasts y[nrY] to y[nrY + horizon - 1] from y[0] to y[nrY - 1] by 
+ * exponential smoothing, all of them are the last level.
+ */
+static void
+forecastDemandBySmoothing( double * y, long nrY, int horizon )
+{
+    double level = y[0];
+    long   t;
+
+
+    for ( t = 1; t < nrY; t++ )
+    {
+        level += DEMAND_FORECAST_ALPHA * ( y[t] - level );
+    }
+
+    for ( t = nrY; t < nrY + horizon; t++ )
+    {
+        y[t] = level;
+    }
+}
+
+
+/* the function sets x to the regressors of y[t], they are 1, the last NUM_FORECAST_LAG 
+ * demands and the demand a day before, where a demand before y[0] is 0.
+ */
+static void
+getDemandForecastRegressor( double * y, long t, double * x )
+{
+    long season = MININTERVALS_IN_DAY * HOURS_IN_DAY;
+    int  k;
+
+
+    x[0] = 1.0;
+
+    for ( k = 1; k <= NUM_FORECAST_LAG; k++ )
+    {
+        x[k] = ( t - k >= 0 ) ? y[t - k] : 0.0;
+    }
+
+    x[NUM_FORECAST_LAG + 1] = ( t - season >= 0 ) ? y[t - season] : 0.0;
+}
+
+
+/* the function forecasts y[nrY] to y[nrY + horizon - 1] from y[0] to y[nrY - 1] by a 
+ * linear model fitted by least squares, and returns 0, or -1 when there are too few 
+ * demands or the normal equations are singular. A small ridge keeps the solution stable 
+ * when a regressor is almost always 0.
+ */
+static int
+forecastDemandByLinearModel( double * y, long nrY, int horizon )
+{
+    enum { NUM_REGRESSOR = NUM_FORECAST_LAG + 2 };
+
+    double a[NUM_REGRESSOR][NUM_REGRESSOR + 1] = { { 0.0 } };
+    double beta[NUM_REGRESSOR];
+    double x[NUM_REGRESSOR];
+    double factor;
+    double ridge = 0.0;
+    double tmp;
+    long   t;
+    int    pivot;
+    int    i;
+    int    j;
+    int    k;
+
+
+    if ( nrY < 2 * NUM_REGRESSOR )
+    {
+        return -1;
+    }
+
+    // the normal equations are a[i][0..NUM_REGRESSOR - 1] beta = a[i][NUM_REGRESSOR]
+
+    for ( t = 1; t < nrY; t++ )
+    {
+        getDemandForecastRegressor( y, t, x );
+
+        for ( i = 0; i < NUM_REGRESSOR; i++ )
+        {
+            for ( j = 0; j < NUM_REGRESSOR; j++ )
+            {
+                a[i][j] += x[i] * x[j];
+            }
+
+            a[i][NUM_REGRESSOR] += x[i] * y[t];
+        }
+    }
+
+    for ( i = 0; i < NUM_REGRESSOR; i++ )
+    {
+        ridge += a[i][i];
+    }
+
+    for ( i = 1; i < NUM_REGRESSOR; i++ )
+    {
+        a[i][i] += DEMAND_FORECAST_RIDGE * ridge;
+    }
+
+    // gaussian elimination with partial pivoting
+
+    for ( i = 0; i < NUM_REGRESSOR; i++ )
+    {
+        pivot = i;
+        for ( j = i + 1; j < NUM_REGRESSOR; j++ )
+        {
+            if ( fabs( a[j][i] ) > fabs( a[pivot][i] ) )
+            {
+                pivot = j;
+            }
+        }
+
+        if ( fabs( a[pivot][i] ) <= DEMAND_FORECAST_RIDGE * ridge )
+        {
+            return -1;
+        }
+
+        for ( k = 0; k <= NUM_REGRESSOR; k++ )
+        {
+            tmp = a[i][k];
+            a[i][k] = a[pivot][k];
+            a[pivot][k] = tmp;
+        }
+
+        for ( j = i + 1; j < NUM_REGRESSOR; j++ )
+        {
+            factor = a[j][i] / a[i][i];
+            for ( k = i; k <= NUM_REGRESSOR; k++ )
+            {
+                a[j][k] -= factor * a[i][k];
+            }
+        }
+    }
+
+    for ( i = NUM_REGRESSOR - 1; i >= 0; i-- )
+    {
+        beta[i] = a[i][NUM_REGRESSOR];
+        for ( k = i + 1; k < NUM_REGRESSOR; k++ )
+        {
+            beta[i] -= a[i][k] * beta[k];
+        }
+
+        beta[i] /= a[i][i];
+    }
+
+    // a demand is not negative
+
+    for ( t = nrY; t < nrY + horizon; t++ )
+    {
+        getDemandForecastRegressor( y, t, x );
+
+        y[t] = 0.0;
+        for ( i = 0; i < NUM_REGRESSOR; i++ )
+        {
+            y[t] += beta[i] * x[i];
+        }
+
+        y[t] = ( y[t] < 0.0 ) ? 0.0 : y[t];
+    }
+
+    return 0;
+}
+
+
+/* the function prints the forecasts of a cell of index like the demands, arg is the 
+ * DemandForecastSpec. The demands of the same min interval are added up.
+ */
+void
+printDemandForecastOfGeohash6( FILE * out, DemandIndex * index, long cell, void * arg )
+{
+    DemandForecastSpec * spec = arg;
+    Demand           * * dptr = index->d + index->offset[cell];
+    long                 nrDemand = index->offset[cell + 1] - index->offset[cell];
+    long                 season = MININTERVALS_IN_DAY * HOURS_IN_DAY;
+    long                 first;
+    long                 nrY;
+    long                 t;
+    long                 j;
+    double             * y;
+    Demand               d;
+
+
+    if ( 0 == nrDemand )
+    {
+        return;
+    }
+
+    first = getMinIntervalOfYear( dptr[0] );
+    nrY = spec->last - first + 1;
+
+    y = calloc( nrY + spec->horizon, sizeof( y[0] ) );
+    if ( NULL == y )
+    {
+        fprintf( stderr, "failed to allocate memory for DemandForecast\n" );
+        exit( 1 );
+    }
+
+    for ( j = 0; j < nrDemand; j++ )
+    {
+        y[getMinIntervalOfYear( dptr[j] ) - first] += dptr[j]->value;
+    }
+
+    switch ( spec->model )
+    {
+        case FORECAST_NAIVE:
+            for ( t = nrY; t < nrY + spec->horizon; t++ )
+            {
+                y[t] = ( t - season >= 0 ) ? y[t - season] : 0.0;
+            }
+
+            break;
+
+        case FORECAST_SMOOTH:
+            forecastDemandBySmoothing( y, nrY, spec->horizon );
+            break;
+
+        case FORECAST_LINEAR:
+            if ( forecastDemandByLinearModel( y, nrY, spec->horizon ) < 0 )
+            {
+                forecastDemandBySmoothing( y, nrY, spec->horizon );
+            }
+
+            break;
+    }
+
+    d.geohash6 = dptr[0]->geohash6;
+
+    for ( t = nrY; t < nrY + spec->horizon; t++ )
+    {
+        j = first + t;
+        d.day = j / ( MININTERVALS_IN_DAY * HOURS_IN_DAY ) + 1;
+        d.hh = ( j / MININTERVALS_IN_DAY ) % HOURS_IN_DAY;
+        d.mm = ( j % MININTERVALS_IN_DAY ) * MIN_IN_MININTERVAL;
+        d.value = y[t];
+
+        printDemand( out, &d );
+    }
+
+    free( y );
+}
+
+/* End of DemandForecast API */
+
+
+/* the function parses the following pattern of string into both from and to values 
+ * in each call. Passing NULL as s when you want to continue parsing where the last 
+ * parse stops, which is kept in save like strtok_r.
+ *
+ * 1,3,5
+ * - 1st parse (not NULL) will reeturn 1 and 1
+ * - 2nd parse (NULL) will return 3 and 3
+ * - 3rd parse (NULL) will return 5 and 5
+ *
+ * 1..3,5,7..9
+ * - 1st parse (not NULL) will return 1 and 3 
+ * - 2nd parse (NULL) will return 5 and 5
+ * - 3rd parse (NULL) will return 7 and 9
+ *
+ * it returns 1 when parsing is success, 0 when EOF (no data for further parsing)
+ * -1 when it fails to parse the string because of none-numeric character or because
+ * instead of 1..5, we put 1.,5
+ */
+int
+parseRange( char * s, int * from, int * to, char * * save )
+{
+    int    val;
+    int    c;
+    char * ls;
+
+
+    if ( NULL != s )
+    {
+        *save = s;
+    }
+   
+    ls = *save;
+    assert( NULL != ls );
+
+    if ( '\0' == *ls )
+    {
+        return 0;
+    }
+ 
+    val = 0;
+    while ( ( c = *ls ) != '\0'
+            && isdigit( c ) )
+    {
+        val = val * 10 + ( c - '0' );
+        ls++;
+    }
+
+    if ( '\0' != c
+         && '.' != c 
+         && ',' != c )
+    {
+        return -1;
+    }
+
+    *from = val;
+    *to = val;
+
+    if ( ',' == c )
+    {
+        ls++;
+    }
+    else if ( '.' == c )
+    {
+        ls++;
+
+        if ( ( c = *( ls++ ) ) != '.' )
+        {
+            return -1;
+        }
+
+        val = 0;
+        while ( ( c = *ls ) != '\0'
+                && isdigit( c ) )
+        {
+            val = val * 10 + ( c - '0' );
+            ls++;
+        }
+
+        if ( '\0' != c
+             && '.' != c
+             && ',' != c )
+        {
+            return -1;
+        }
+  
+        *to = val;
+
+        if ( ',' == c )
+        {
+            ls++;
+        }
+    }
+
+    *save = ls;
+
+    return 1;
+}
+
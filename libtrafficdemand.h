@@ -0,0 +1,914 @@
+/*
+ * Copyright 2019, Chee Bin Hoh, All right reserved.
+ *
+ * This is the private interface of the traffic demand library, libtrafficdemand.c, which reads, 
+ * filters, aggregates and indexes traffic demand dataset. trafficdemand.c is the command-line 
+ * interface over it, and a program embeds it through DemandDataset API of trafficdemand.h. 
+ * No function keeps state between calls, so the functions are called by any number of threads 
+ * at the same time on their own objects, and a DemandIndex or DemandDataset is shared by the 
+ * queries of the threads.
+ *
+ */
+
+
+#ifndef LIBTRAFFICDEMAND_H
+#define LIBTRAFFICDEMAND_H
+
+
+#include <stdio.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "trafficdemand.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+enum 
+{
+    NUM_DEMAND_PER_NODE  = 500,
+    MIN_IN_MININTERVAL   = 15,
+    MININTERVALS_IN_DAY  = 4,
+    MINS_IN_HOUR         = 60,
+    HOURS_IN_DAY         = 24,
+    DAYS_IN_YEAR         = 365,
+    HOURS_IN_YEAR        = DAYS_IN_YEAR * HOURS_IN_DAY,  
+    MININTERVALS_IN_YEAR = HOURS_IN_YEAR * MININTERVALS_IN_DAY,
+    HASH_MULTIPLIER      = 37,
+    NUM_HASH_SIZE        = 5000,
+    GEOHASH6_LEN         = 6,
+    BITS_IN_GEOHASH_CHAR = 5,
+    MIN_NUM_GEOHASH6_SLOT = 1024,
+    BITS_IN_RADIX        = 8,
+    NUM_RADIX            = 1 << BITS_IN_RADIX,
+    MAX_NUM_THREAD       = 256,
+    MAX_VALUE_LEN        = 512,
+    MAX_NUM_PHASE        = 8,
+    FOLLOW_INTERVAL_MS   = 500,
+    MAX_NUM_FEATURE      = 32,
+    NUM_TASK_PER_THREAD  = 16,
+    MAX_NUM_HORIZON      = 96,
+    NUM_FORECAST_LAG     = 4,
+    NUM_DECOMPRESSED_BUFFER = 4,
+    DECOMPRESSED_BUFFER_SIZE = 1 << 20,
+    UNORDERED_CHUNK_SIZE = 1 << 22,
+    NUM_PENDING_CHUNK_PER_THREAD = 2,
+    NUM_DEMAND_IN_BLOCK  = 4096,
+    BITS_IN_WORD         = 64,
+    GEOHASH6_PREFIX_LEN  = 4,
+    NUM_GEOHASH6_PREFIX  = 1 << ( GEOHASH6_PREFIX_LEN * BITS_IN_GEOHASH_CHAR ),
+    MIN_NUM_DEMAND_IN_SEGMENT = 4096,
+    BITS_IN_BLOOM_PER_GEOHASH6 = 16,
+    NUM_BLOOM_HASH       = 3,
+    MAX_NUM_BLOOM_PROBE  = 64,
+    MAX_NUM_IOVEC        = 1024,
+    MAX_NUM_SKETCH_BIN   = 2048,
+    MAX_NUM_SKETCH_GEOHASH6 = 64,
+    BITS_IN_SKETCH_REGISTER = 12,
+    NUM_SKETCH_REGISTER  = 1 << BITS_IN_SKETCH_REGISTER
+};
+
+
+#define EMPTY_GEOHASH6          UINT32_MAX
+
+
+/* the cache is written in the byte order of the machine that builds it, the byte 
+ * order field tells us when it is loaded on another machine.
+ */
+#define DEMAND_CACHE_MAGIC      "TDCACHE"
+#define DEMAND_CACHE_BYTE_ORDER 0x01020304
+#define DEMAND_CACHE_VERSION    3
+#define DEMAND_CUBE_MAGIC       "TDCUBE"
+#define DEMAND_CUBE_VERSION     2
+#define DEMAND_FORECAST_ALPHA   0.3
+#define DEMAND_FORECAST_RIDGE   1e-6
+#define DEMAND_SKETCH_ACCURACY  0.01
+
+
+enum
+{
+    FORECAST_NAIVE,
+    FORECAST_SMOOTH,
+    FORECAST_LINEAR,
+    NUM_FORECAST
+};
+
+
+enum
+{
+    COMPRESSION_NONE,
+    COMPRESSION_GZIP,
+    COMPRESSION_ZSTD
+};
+
+
+typedef struct demandingeohash6 DemandInGeohash6; 
+
+struct demandingeohash6
+{
+    long     nrDemand;
+    uint32_t geohash6;
+};
+
+
+typedef struct demandingeohash6slot DemandInGeohash6Slot;
+
+struct demandingeohash6slot
+{
+    uint32_t geohash6;  // EMPTY_GEOHASH6 when the slot is not used
+    int32_t  id;        // index of DemandInGeohash6 in the table
+};
+
+
+typedef struct demandingeohash6table DemandInGeohash6Table;
+
+struct demandingeohash6table
+{
+    long                   nrGeohash6;
+    long                   maxGeohash6;
+    DemandInGeohash6     * item;  // in the order of insertion
+    long                   nrSlot;
+    DemandInGeohash6Slot * slot;
+};
+
+
+typedef struct demandsketchstore DemandSketchStore;
+
+struct demandsketchstore
+{
+    int    offset;  // bucket of cnt[0]
+    int    nrBin;
+    long * cnt;
+};
+
+
+struct demandsketch
+{
+    DemandSketchStore positive;  // values more than 0 by their bucket,
+    DemandSketchStore negative;  // and values less than 0 by the bucket of their absolute value
+    long              nrZero;
+    long              nrPositiveInf;  // inf and -inf have no bucket, they are the highest
+    long              nrNegativeInf;  // and lowest values
+    long              nrNan;          // any nan makes the quantiles nan
+    uint32_t        * geohash6;  // distinct geohash6 while there are few of them,
+    int               nrGeohash6;
+    uint8_t         * rank;      // and HyperLogLog registers after, NULL before
+};
+
+
+typedef struct geohash6range Geohash6Range;
+
+struct geohash6range
+{
+    uint32_t from;
+    uint32_t to;
+};
+
+
+typedef struct demandfilter DemandFilter;
+
+struct demandfilter
+{
+    int             day[DAYS_IN_YEAR];
+    int             hourMinInterval[MININTERVALS_IN_DAY * HOURS_IN_DAY];
+    Geohash6Range * geohash6;  // sorted ranges, NULL when demands are not filtered by geohash6
+    long            nrGeohash6;
+    long            maxGeohash6;
+    uint64_t        minInterval[( MININTERVALS_IN_YEAR + BITS_IN_WORD - 1 ) / BITS_IN_WORD];  // day and time of -d and -t
+    uint64_t      * isPrefixAny;  // a bit for each geohash6 prefix with any geohash6 matched, 
+    uint64_t      * isPrefixAll;  // and with all of them matched, NULL when not filtered by geohash6
+    uint64_t        sampleThreshold;  // a demand is sampled when its hash is not more than it
+};
+
+
+typedef struct demandbuffer DemandBuffer;
+
+struct demandbuffer
+{
+    Demand * d;
+    long     nrDemand;
+    long     maxDemand;
+};
+
+
+typedef struct demandphase DemandPhase;
+
+struct demandphase
+{
+    const char * name;
+    double       wall;  // seconds
+    double       cpu;   // seconds of all threads
+};
+
+
+typedef struct demandstats DemandStats;
+
+struct demandstats
+{
+    long        nrRead;        // lines, or demands of a cache or cube file
+    long        nrRejected;    // lines that are not demands, like the header
+    long        nrMatched;     // demands matching the filters
+    int         nrPhase;
+    DemandPhase phase[MAX_NUM_PHASE];
+    long        nrGeohash6;    // geohash6 table of DemandIndex
+    long        nrSlot;
+    long        longestProbe;
+    long        nrGroup;       // chained hash of DemandAggregate
+    long        nrBucket;
+    long        longestChain;
+    size_t      bufferSize;    // bytes allocated for the matching demands
+    size_t      indexSize;     // bytes allocated for DemandIndex
+};
+
+
+typedef struct demandquery DemandQuery;
+
+struct demandquery
+{
+    DemandFilter      filter;
+    DemandAggregate * agg;          // NULL when matching demands are not aggregated
+    int               isUnordered;  // matching demands are printed as they are read
+    int               isApproximate;  // chunks are aggregated by the threads and merged
+    DemandBuffer      result;       // matching demands kept for ordered output
+    DemandStats       stats;
+};
+
+
+Demand *
+scanDemand( char * cptr, Demand * dptr );
+
+int
+isDemandInTimeFilter( DemandFilter * filter, Demand * d );
+
+int
+isDemandSampled( DemandFilter * filter, Demand * d );
+
+int
+isDemandInFilter( DemandFilter * filter, Demand * d );
+
+void
+appendDemand( DemandBuffer * buf, Demand * d );
+
+void
+processDemandInQuery( DemandQuery * query, Demand * d );
+
+int
+parseRange( char * s, int * from, int * to, char * * save );
+
+
+/* Start of DemandValue API
+ *
+ * Demand values are parsed and printed without the C library in the common case, so they 
+ * do not depend on locale. A decimal value with at most 19 significant digits, a mantissa 
+ * that fits in 53 bits and a power of 10 within 22 is the exact result of one multiply or 
+ * divide of two exact doubles, and any other value is parsed by strtod. A value is printed 
+ * with 18 decimals by rounding its exact binary value times 10^18 as a 128 bits integer, 
+ * half to even like printf, and printf is used when the compiler has no 128 bits integer 
+ * or the value is not finite or has no fraction bits. Both give the same result as strtod 
+ * and printf.
+ */
+
+char *
+parseDemandValue( char * s, double * value );
+
+char *
+formatDemandValue( double value, char * s );
+
+/* End of DemandValue API */
+
+
+/* Start of DemandInTime API 
+ * 
+ * DemandInTime orders demands by day, hour and min interval. The demands are sorted by 
+ * their min interval of the year with a stable radix sort, so demands in the same min 
+ * interval stay in the order they are given, and it only needs a temporary array of 
+ * the same size instead of a bucket for every day, hour and min interval of the year.
+ */
+
+long
+getMinIntervalOfYear( Demand * d );
+
+void
+sortDemandInTime( Demand * * dptr, Demand * * tmp, long nrDemand );
+
+/* End of DemandInTime API */
+
+
+/* Start of DemandInGeohash6 API 
+ *
+ * DemandInGeohash6 is ADT that allows us to organize demands by geohash6 value, it counts the
+ * demands of each geohash6 and DemandIndex keeps the demands in one array at their offsets.
+ *
+ * A geohash6 value is 6 base32 characters, it is encoded into 30 bits integer when a demand 
+ * is scanned. The ADT is an open addressing hash structure with linear probing, each slot keeps 
+ * the geohash6 value and the index of its DemandInGeohash6 object, so a lookup walks adjacent
+ * slots without following pointer. DemandInGeohash6 objects are kept in an array in the order 
+ * of insertion, and both the slots and the array are doubled when they are half full.
+ */
+
+int
+getValueOfGeohashChar( int c );
+
+long
+encodeGeohash6( char * s );
+
+char *
+decodeGeohash6( uint32_t geohash6, char * s );
+
+long
+getHashValueOfString( char * s );
+
+DemandInGeohash6Table *
+newDemandInGeohash6( void );
+
+void
+deleteDemandInGeohash6( DemandInGeohash6Table * digh6 );
+
+DemandInGeohash6 *
+insertGeohash6( DemandInGeohash6Table * digh6, uint32_t geohash6, int createIfNotExist  );
+
+long
+getLongestProbeOfDemandInGeohash6( DemandInGeohash6Table * digh6 );
+
+DemandInGeohash6 *
+insertDemandInGeohash6( DemandInGeohash6Table * digh6, Demand * d, int createIfNotExist );
+
+void
+processDemandInGeohash6( DemandInGeohash6Table * digh6, Demand * d, long nrDemand, int createIfNotExist );
+
+/* End of DemandInGeohash6 API */ 
+
+
+/* Start of Geohash6Range API
+ *
+ * Geohash6Range is the geohash6 filter. The encoded geohash6 values keep the order of their 
+ * strings, so all geohash6 under a prefix are a range of values, a geohash6 is a range of 
+ * one value and a bounding box is covered by ranges found by walking down the prefixes 
+ * from the box of 1 character. The ranges are sorted and merged once, then a demand is 
+ * matched by a binary search, and a sorted dictionary of geohash6 is walked range by range 
+ * so that only the matching geohash6 are touched.
+ */
+
+void
+insertGeohash6Range( DemandFilter * filter, uint32_t from, uint32_t to );
+
+int
+insertGeohash6PrefixRange( DemandFilter * filter, char * prefix );
+
+int
+insertGeohash6BoxRange( DemandFilter * filter, char * box );
+
+void
+sortGeohash6Range( DemandFilter * filter );
+
+int
+isGeohash6InFilter( DemandFilter * filter, uint32_t geohash6 );
+
+void
+markGeohash6InFilter( DemandFilter * filter, uint32_t * geohash6, long nrGeohash6, char * isMatched );
+
+/* End of Geohash6Range API */
+
+
+/* Start of DemandSketch API
+ *
+ * DemandSketch summarizes values and geohash6 of demands in a bounded space, and two of 
+ * them are merged into the summary of both. Quantiles are answered from the counts of 
+ * buckets of values growing by a factor of ( 1 + DEMAND_SKETCH_ACCURACY ) / ( 1 - 
+ * DEMAND_SKETCH_ACCURACY ), so a quantile is within DEMAND_SKETCH_ACCURACY of the value at 
+ * its rank, until there are more than MAX_NUM_SKETCH_BIN buckets and the lowest of them are 
+ * collapsed. inf and -inf are counted apart from the buckets as the highest and lowest 
+ * values, so a quantile at their rank is inf or -inf. A nan value has no rank, and like the 
+ * sum and mean, the quantiles of a group with a nan value are nan. The number of distinct 
+ * geohash6 is exact up to MAX_NUM_SKETCH_GEOHASH6 of them, then it is estimated by HyperLogLog 
+ * with NUM_SKETCH_REGISTER registers, about 1.6% error.
+ */
+
+DemandSketch *
+newDemandSketch( void );
+
+void
+deleteDemandSketch( DemandSketch * sketch );
+
+void
+insertValueInDemandSketch( DemandSketch * sketch, double value );
+
+void
+insertGeohash6InDemandSketch( DemandSketch * sketch, uint32_t geohash6 );
+
+void
+mergeDemandSketch( DemandSketch * sketch, DemandSketch * from );
+
+double
+getQuantileOfDemandSketch( DemandSketch * sketch, double q );
+
+double
+getDistinctOfDemandSketch( DemandSketch * sketch );
+
+/* End of DemandSketch API */
+
+
+/* Start of DemandAggregate API
+ *
+ * DemandAggregate is ADT that allows us to summarize demands (count, sum, mean, min, max
+ * and stddev) in one pass without keeping the demands. Demands are grouped by any of 
+ * geohash6, day and hour or 15 minutes interval, the groups are kept in a hash structure 
+ * that grows with the number of groups. The top groups by the first aggregate are found 
+ * by a heap of the top groups seen so far, so only that many groups are sorted.
+ * The quantiles (p50, p90 and p99) and the number of distinct geohash6 of a group are 
+ * approximated by its DemandSketch. Two aggregates of the same groups and aggregates are 
+ * merged, stddev by the parallel form of Welford's method.
+ */
+
+int
+parseAggregate( char * s, int * aggregate );
+
+int
+parseGroupBy( char * s );
+
+DemandAggregate *
+newDemandAggregate( int groupBy, int * aggregate, int nrAggregate );
+
+void
+deleteDemandAggregate( DemandAggregate * agg );
+
+DemandInGroup *
+insertGroupInAggregate( DemandAggregate * agg, Demand * d );
+
+DemandInGroup *
+insertDemandInAggregate( DemandAggregate * agg, Demand * d );
+
+DemandInGroup *
+mergeDemandInAggregate( DemandAggregate * agg, Demand * d, long cnt, double sum );
+
+void
+mergeDemandAggregate( DemandAggregate * agg, DemandAggregate * from );
+
+void
+forEachDemandInGroup( DemandAggregate * agg, DemandInGroupFunction function, void * arg );
+
+void
+printDemandAggregate( FILE * out, DemandAggregate * agg );
+
+void
+printTopOfDemandAggregate( FILE * out, DemandAggregate * agg, long nrTop );
+
+long
+getLongestChainOfDemandAggregate( DemandAggregate * agg );
+
+/* End of DemandAggregate API */
+
+
+/* Start of DemandCache API
+ *
+ * DemandCache is a binary file of demands that can be memory mapped and queried without 
+ * parsing. It starts with a header, then a dictionary of sorted encoded geohash6 values followed 
+ * by a column for each field of demand: the dictionary index of geohash6, day, minute of 
+ * the day and value. Each section starts at an offset aligned to 8 bytes.
+ *
+ * The demands are sorted by day (keeping their order within a day) and partitioned into 
+ * segments of whole days with at least MIN_NUM_DEMAND_IN_SEGMENT demands, so a segment is 
+ * the same range of rows in every column. Each segment has a zone map of its first and last 
+ * day, the min intervals of the day it has and a bloom filter of its geohash6, and a query 
+ * only touches the segments whose zone map can match its filters, the pages of the others 
+ * are never read. When the demands are not given in the order of day, a column of their 
+ * position in the input puts the matching demands back in that order.
+ */
+
+typedef struct demandcacheheader DemandCacheHeader;
+
+struct demandcacheheader
+{
+    char     magic[8];
+    uint32_t byteOrder;
+    uint32_t version;
+    uint32_t nrGeohash6;
+    uint32_t nrSegment;
+    uint64_t nrDemand;
+    uint64_t geohash6Offset;  // uint32_t encoded geohash6 for each dictionary entry
+    uint64_t idOffset;        // uint32_t index into the geohash6 dictionary for each demand
+    uint64_t dayOffset;       // uint16_t day for each demand
+    uint64_t minuteOffset;    // uint16_t hh * 60 + mm for each demand
+    uint64_t valueOffset;     // double value for each demand
+    uint64_t positionOffset;  // uint32_t position in the input for each demand, 0 when they are in input order
+    uint64_t segmentOffset;   // DemandCacheSegment for each segment
+    uint64_t bloomOffset;     // uint64_t words of the bloom filters of all segments
+    uint64_t nrBloomWord;
+};
+
+
+typedef struct demandcachesegment DemandCacheSegment;
+
+struct demandcachesegment
+{
+    uint64_t from;        // demands from and before to
+    uint64_t to;
+    uint16_t minDay;
+    uint16_t maxDay;
+    uint32_t nrBloomBit;  // a power of 2, NUM_BLOOM_HASH bits are set for each geohash6
+    uint64_t bloomWord;   // first word of the bloom filter in the bloom section
+    uint64_t minInterval[( MININTERVALS_IN_DAY * HOURS_IN_DAY + BITS_IN_WORD - 1 ) / BITS_IN_WORD];
+};
+
+void
+writeDemandCache( char * path, DemandBuffer * buf );
+
+int
+isDemandCache( char * base, size_t size );
+
+int
+readDemandFromCache( DemandQuery * query, char * base, size_t size, char * err );
+
+/* End of DemandCache API */
+
+
+/* Start of DemandColumn API
+ *
+ * DemandColumn filters and aggregates the columns of a DemandCache block by block without 
+ * making a demand of each row. The filters are compiled into tables of -1 (matched) or 0 for 
+ * each dictionary index, day and minute of the day, with an extra 0 entry that an index out 
+ * of range is clamped to, so a row is matched by 3 table lookups and ANDs without branches. 
+ * The matched rows of a block are a bitmap, and count, sum, min and max of the matched values 
+ * are computed from it. The AVX2 kernels match 8 rows with gathers and compute min and max of 
+ * 4 values at once, and are used when the CPU has AVX2, otherwise the scalar kernels are. The 
+ * sum is added in the order of the rows by both, so it is the same as adding the demands 
+ * one by one. A zero min or max is taken again from the rows in order, as the lanes do not 
+ * keep the first of 0 and -0 like the scalar kernel.
+ */
+
+typedef struct demandcolumn DemandColumn;
+
+struct demandcolumn
+{
+    uint32_t * id;
+    uint16_t * day;
+    uint16_t * minute;
+    double   * value;
+    int32_t  * isIdMatched;                                         // nrGeohash6 + 1 entries
+    uint32_t   nrGeohash6;
+    int32_t    isDayMatched[DAYS_IN_YEAR + 2];                      // by day from 1
+    int32_t    isMinuteMatched[HOURS_IN_DAY * MINS_IN_HOUR + 1];    // by hh * 60 + mm
+};
+
+void
+compileDemandColumnFilter( DemandColumn * column, DemandFilter * filter, char * isGeohash6Matched );
+
+long
+matchDemandColumn( DemandColumn * column, uint64_t from, uint64_t to, uint64_t * bitmap );
+
+void
+aggregateDemandColumn( DemandColumn * column, uint64_t from, uint64_t to, uint64_t * bitmap, DemandInGroup * group );
+
+/* End of DemandColumn API */
+
+
+/* Start of DemandCube API
+ *
+ * DemandCube is a binary file of the sum and count of demands of each geohash6 by day and 
+ * min interval of the day, the DemandInTime layout flattened, kept as prefix sums over both 
+ * day and min interval. The sum of any range of days and range of min intervals is then 4 
+ * lookups, so count, sum and mean matching -d and -t are computed in constant time for each 
+ * geohash6 without the demands. The header is followed by the sorted dictionary of encoded 
+ * geohash6 values, a block for each geohash6 at geohash6 index * cellSize from cellOffset and 
+ * a scan flag for each geohash6 at scanOffset, written last. A block has ( nrDay + 1 ) * ( MININTERVALS_IN_DAY * 
+ * HOURS_IN_DAY + 1 ) prefix sums of value as double-double, the high doubles followed by the 
+ * low doubles, and then the prefix sums of count as uint32_t in the same layout, where the 
+ * first row and column are 0. When a prefix sum of a geohash6 is not finite, its flag is 1 
+ * and the high doubles of its block are the sum of each cell, added up by a scan.
+ */
+
+typedef struct demandcubeheader DemandCubeHeader;
+
+struct demandcubeheader
+{
+    char     magic[8];
+    uint32_t byteOrder;
+    uint32_t version;
+    uint32_t nrGeohash6;
+    uint32_t nrDay;           // day 1 to nrDay are in the cube
+    uint64_t geohash6Offset;  // uint32_t encoded geohash6 for each dictionary entry
+    uint64_t cellOffset;
+    uint64_t cellSize;
+    uint64_t scanOffset;      // uint8_t for each dictionary entry, 1 when its block is scanned
+};
+
+void
+writeDemandCube( char * path, DemandBuffer * buf );
+
+int
+isDemandCube( char * base, size_t size );
+
+int
+readDemandFromCube( DemandQuery * query, char * base, size_t size, char * err );
+
+/* End of DemandCube API */
+
+
+/* Start of demand input API
+ *
+ * Demands are read from a stream line by line, except a regular file which is memory 
+ * mapped and split into chunks at line boundaries. The chunks of all files are scanned 
+ * and filtered together by the threads, each chunk into its own DemandBuffer, and the 
+ * buffers are processed in the order of the files and chunks afterward, so the result 
+ * is the same as reading the files one after another line by line. A file has a share 
+ * of the chunks by its size, so many files are read in about the time of all of them 
+ * over the number of threads. With -u, a chunk is at most UNORDERED_CHUNK_SIZE bytes and 
+ * is printed as soon as it and the chunks before it are scanned, and the threads take at 
+ * most NUM_PENDING_CHUNK_PER_THREAD chunks each ahead of the printed ones, so the memory 
+ * of the matching demands is bounded. An approximate query aggregates each chunk in its thread 
+ * instead of keeping the matching demands, and the aggregates are merged in the same order.
+ * A mapped file that is a DemandCache is queried directly from its columns, and a 
+ * DemandCube from its prefix sums. A cache or cube that is from another version, truncated 
+ * or corrupted, a cube that can not answer the query, or a gzip or zstd file that ends at an 
+ * error makes readDemand return -1 with the error in err, and the files after it are not read.
+ *
+ * A gzip or zstd file (or standard input) is decompressed by its own thread into a ring 
+ * of NUM_DECOMPRESSED_BUFFER buffers of whole lines while the lines of the buffers before 
+ * them are scanned, so decompression and scanning overlap without a pipe from zcat. gzip 
+ * is read when it is built with -DHAVE_ZLIB -lz, and zstd with -DHAVE_ZSTD -lzstd.
+ *
+ * A followed file is read from the offset after its last complete line each time it 
+ * grows, so only the appended lines are scanned. The new matching demands are printed, 
+ * or with -a, the groups they change.
+ */
+
+void
+readDemandFromStream( DemandQuery * query, FILE * file );
+
+int
+getDemandCompression( unsigned char * s, size_t len );
+
+int
+readDemandFromCompressedStream( DemandQuery * query, FILE * file, int compression, char * err );
+
+int
+readDemand( DemandQuery * query, FILE * * file, int nrFile, int nrThread, char * err );
+
+int
+readAppendedDemand( DemandQuery * query, int fd, off_t * offset, DemandBuffer * batch );
+
+void
+readDemandFromFollowedFile( DemandQuery * query, int fd, off_t * offset );
+
+void
+followDemand( DemandQuery * query, int fd, off_t offset );
+
+/* End of demand input API */
+
+
+/* Start of DemandQuery API
+ *
+ * DemandQuery options -g, -b, -d, -t, -a and -k are parsed by the same functions from the 
+ * command line and from a query sent to the server. An invalid argument returns -1 with the 
+ * error message in err, which has room for MAX_ERROR_LEN characters, instead of exiting.
+ *
+ * The filter is compiled once it is parsed. -d and -t become one bitset over the min intervals 
+ * of the year, and -g and -b a bitset of the geohash6 prefixes of GEOHASH6_PREFIX_LEN characters 
+ * with any geohash6 matched and another with all of them matched. A demand is then matched by 
+ * a bit test for its time and one or two for its geohash6, and the sorted ranges are only 
+ * searched for a prefix that is partly matched.
+ *
+ * A query with a sample rate below 1 only matches the demands whose hash of geohash6, day, 
+ * time and value is in that fraction of the hash values, so the same demands are sampled 
+ * from a text file and from a DemandCache of it, by any number of threads.
+ */
+
+void
+initDemandFilter( DemandFilter * filter );
+
+void
+compileDemandFilter( DemandFilter * filter );
+
+int
+parseGeohash6Filter( DemandFilter * filter, char * s, DemandInGeohash6Table * listed, char * err );
+
+int
+parseGeohash6BoxFilter( DemandFilter * filter, char * s, char * err );
+
+int
+parseDayFilter( DemandFilter * filter, char * s, char * err );
+
+int
+parseTimeFilter( DemandFilter * filter, char * s, char * err );
+
+int
+parseDemandQuery( DemandQuery * query, char * line, DemandInGeohash6Table * listed, char * err );
+
+void
+setSampleRateOfDemandQuery( DemandQuery * query, double rate );
+
+/* End of DemandQuery API */
+
+
+/* Start of DemandIndex API
+ *
+ * DemandIndex organizes the demands of a DemandBuffer by geohash6 and time once, so that 
+ * many queries are answered without reading the demands again. The demands of each geohash6 
+ * are sorted by time into one array, and the geohash6 values are kept sorted with their 
+ * position in it, so a geohash6 filter only visits the matching geohash6. The array is built 
+ * in two passes, counting the demands of each geohash6 and then filling them at the offsets, 
+ * so it takes a pointer for each demand and is walked sequentially, and the geohash6 are 
+ * sorted by time by the threads. Queries do not change the index, so it is shared by the 
+ * threads of the server without locking.
+ */
+
+typedef struct demandindex DemandIndex;
+
+struct demandindex
+{
+    DemandBuffer          * buf;
+    DemandInGeohash6Table * cell;      // geohash6 in the order they first appear in buf
+    long                  * offset;    // demands of cell i are d[offset[i]] to d[offset[i + 1] - 1]
+    Demand            * * d;
+    long                  * hashkey;   // hash value of the geohash6 string of each cell
+    uint32_t              * geohash6;  // sorted geohash6 values of the cells
+    long                  * id;        // cell of each sorted geohash6 value
+};
+
+DemandIndex *
+newDemandIndex( DemandBuffer * buf, int nrThread );
+
+void
+deleteDemandIndex( DemandIndex * index );
+
+void
+forEachDemandInIndex( DemandIndex * index, DemandFilter * filter, DemandInGeohash6Table * listed, DemandFunction function, void * arg );
+
+void
+printDemandIndex( FILE * out, DemandIndex * index, DemandFilter * filter, DemandInGeohash6Table * listed, int nrThread );
+
+void
+processDemandIndexInQuery( DemandQuery * query, DemandIndex * index );
+
+int
+queryDemandIndex( DemandIndex * index, char * line, DemandFunction onDemand, DemandInGroupFunction onGroup, void * arg, char * err );
+
+size_t
+getSizeOfDemandIndex( DemandIndex * index );
+
+long
+getLastMinIntervalOfDemandIndex( DemandIndex * index );
+
+/* End of DemandIndex API */
+
+
+/* Start of DemandDataset API
+ *
+ * A DemandDataset is the demands of the files read with the filters of its load query, 
+ * and the DemandIndex over them.
+ */
+
+struct demanddataset
+{
+    DemandQuery   load;   // filters applied when the files are read, and the matching demands
+    DemandIndex * index;
+};
+
+/* End of DemandDataset API */
+
+
+/* Start of DemandServer API
+ *
+ * The server answers queries from a DemandIndex over a unix domain socket. A query is a 
+ * line of -g, -b, -d, -t, -a and -k options as they are given on the command line, and the 
+ * response is the lines the command line would print followed by an empty line, or a line 
+ * starting with "error: " and an empty line. Each connection is served by its own thread 
+ * and can send any number of queries. A connection that can not be opened by its thread 
+ * is logged and closed, and the server keeps serving the others.
+ */
+
+void
+serveDemandIndex( char * path, DemandIndex * index );
+
+int
+queryDemandServer( char * path, char * line );
+
+char *
+appendDemandQueryLine( char * line, int opt, char * arg );
+
+/* End of DemandServer API */
+
+
+/* Start of DemandStats API
+ *
+ * DemandStats counts the rows read, rejected and matched by a query, and the wall and CPU 
+ * time of each phase of the program, reading, building the index and printing. With 
+ * --stats, they are printed to standard error together with the load of the hash tables, 
+ * memory of the demands and the index and peak RSS, as text or as one line of JSON.
+ */
+
+void
+startDemandPhase( DemandStats * stats, const char * name );
+
+void
+endDemandPhase( DemandStats * stats );
+
+void
+statDemandIndex( DemandStats * stats, DemandIndex * index );
+
+void
+statDemandAggregate( DemandStats * stats, DemandAggregate * agg );
+
+void
+printDemandStats( FILE * out, DemandStats * stats, int isJson );
+
+/* End of DemandStats API */
+
+
+/* Start of DemandTask API
+ *
+ * DemandTask runs a function for each geohash6 of a DemandIndex on a number of threads, 
+ * in the order of geohash6 values or of a given list of cells. The threads take the next 
+ * geohash6 of a block of them until the block is done, each geohash6 is printed into its 
+ * own memory stream, and the streams of a block are written out in order before the next 
+ * block, so the output is the same with any number of threads. When the output is a file, 
+ * the streams of a block are written by writev after what is buffered in it, so the text 
+ * is not copied again and a block takes a few system calls.
+ */
+
+typedef void ( * DemandTaskFunction )( FILE * out, DemandIndex * index, long cell, void * arg );
+
+void
+runDemandTask( FILE * out, DemandIndex * index, DemandTaskFunction function, void * arg, int nrThread );
+
+void
+runDemandTaskInOrder( FILE * out, DemandIndex * index, long * cell, long nrCell, DemandTaskFunction function, void * arg, int nrThread );
+
+/* End of DemandTask API */
+
+
+/* Start of DemandFeature API
+ *
+ * DemandFeature turns the demands of each geohash6 in time order into a table of features 
+ * for forecasting. There is a row for each min interval with a demand, with the demands of 
+ * the given numbers of min intervals before it (lags) and the sum and mean of the given 
+ * numbers of min intervals before it (windows), where a min interval without demand is 0. 
+ * The min intervals of a geohash6 are walked once from its first demand with a ring buffer 
+ * of the last demands, and the sum of each window is kept by adding the demand that enters 
+ * it and subtracting the demand that leaves it.
+ */
+
+typedef struct demandfeaturespec DemandFeatureSpec;
+
+struct demandfeaturespec
+{
+    int lag[MAX_NUM_FEATURE];     // in min intervals
+    int nrLag;
+    int window[MAX_NUM_FEATURE];  // in min intervals
+    int nrWindow;
+    int span;                     // largest lag or window
+};
+
+int
+parseFeatureList( char * s, int * list );
+
+void
+printDemandFeatureHeader( FILE * out, DemandFeatureSpec * spec );
+
+void
+printDemandFeatureOfGeohash6( FILE * out, DemandIndex * index, long cell, void * arg );
+
+/* End of DemandFeature API */
+
+
+/* Start of DemandForecast API
+ *
+ * DemandForecast predicts the demands of each geohash6 for the min intervals after the last 
+ * min interval of all demands, from the demands of the geohash6 in time order where a min 
+ * interval without demand is 0. The models are
+ *
+ * naive  - the demand of the same min interval a day before
+ * smooth - exponential smoothing of the demands with DEMAND_FORECAST_ALPHA
+ * linear - least squares of the demand on the last NUM_FORECAST_LAG demands and the demand 
+ *          a day before, fitted for each geohash6, and the forecast of a min interval is 
+ *          used as a demand for the next one
+ *
+ * The geohash6 values are forecasted by DemandTask, so they are worked on by all threads.
+ */
+
+typedef struct demandforecastspec DemandForecastSpec;
+
+struct demandforecastspec
+{
+    int  model;
+    int  horizon;  // number of min intervals forecasted
+    long last;     // last min interval of all demands
+};
+
+int
+parseForecastModel( char * s );
+
+void
+printDemandForecastOfGeohash6( FILE * out, DemandIndex * index, long cell, void * arg );
+
+/* End of DemandForecast API */
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -3,181 +3,96 @@
  *
  * This program is built for programming challenge, https://www.aiforsea.com/traffic-management
  *
- * This program provides a simple command-line interface to filter traffic demand dataset.
+ * This program provides a simple command-line interface to filter traffic demand dataset,
+ * over the traffic demand library in libtrafficdemand.c.
  *
  */
 
 
+#define _POSIX_C_SOURCE 200809L
+
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <ctype.h>
 #include <unistd.h>
-#include <assert.h>
-
-
-enum 
-{
-    NUM_DEMAND_PER_NODE  = 500,
-    MIN_IN_MININTERVAL   = 15,
-    MININTERVALS_IN_DAY  = 4,
-    HOURS_IN_DAY         = 24,
-    DAYS_IN_YEAR         = 365,
-    HOURS_IN_YEAR        = DAYS_IN_YEAR * HOURS_IN_DAY,  
-    MININTERVALS_IN_YEAR = HOURS_IN_YEAR * MININTERVALS_IN_DAY,
-    HASH_MULTIPLIER      = 37,
-    NUM_HASH_SIZE        = 5000
-};
-
-
-typedef struct demand Demand;
-
-struct demand
-{
-    char   geohash6[7];
-    int    day;
-    int    hh;
-    int    mm;
-    double value;
-};
-
-
-typedef struct demandnode DemandNode;
+#include <getopt.h>
+#include <sys/types.h>
 
-struct demandnode
-{
-    DemandNode *next;
-    DemandNode *prev;
-    long        cnt;
-    Demand     *d[1]; //varying size, allocated by malloc
-};
+#include "libtrafficdemand.h"
 
 
-typedef struct demandintime DemandInTime;
-
-struct demandintime
+enum
 {
-    DemandNode * day[DAYS_IN_YEAR];
-    DemandNode * hour[HOURS_IN_YEAR];
-    DemandNode * mininterval[MININTERVALS_IN_YEAR]; 
+    OPTION_BUILD_CACHE = 256,
+    OPTION_BUILD_CUBE,
+    OPTION_SERVE,
+    OPTION_CONNECT,
+    OPTION_STATS,
+    OPTION_FOLLOW,
+    OPTION_FEATURES,
+    OPTION_LAGS,
+    OPTION_WINDOWS,
+    OPTION_FORECAST,
+    OPTION_HORIZON,
+    OPTION_TOP,
+    OPTION_APPROX
 };
 
 
-typedef struct demandingeohash6 DemandInGeohash6; 
-
-struct demandingeohash6
-{
-    DemandNode       * d;
-    DemandInGeohash6 * next;
-    char               geohash6[7];
-};
-
-
-Demand *
-scanDemand( char * cptr, Demand * dptr );
-
-int
-parseRange( char * s, int * from, int * to );
-
-
-/* Start of DemandInTime API 
- * 
- * DemandInTime is ADT that allows us to store and organize demands by day and hour 
- * and min interval.
- */
-
-DemandInTime *
-newDemandInTime( void );
-
-void
-deleteDemandInTime( DemandInTime * dit ); 
-
-void
-processDemandInTime( DemandInTime * dit, Demand * dptr, long nrDemand );
-
-void
-processDemandNodeInTime( DemandInTime * dit, DemandNode * list );
-
-void
-printDebugDemandInTime( DemandInTime * dit );
-
-/* End of DemandInTime API */
-
-
-/* Start of DemandNode API 
- */
-
-DemandNode *
-newDemandNode( void );
-
-void
-deleteDemandNode( DemandNode * list );
-
-DemandNode *
-processDemandNode( DemandNode * list, Demand * dptr, long nrDemand );
-
-void
-printDebugDemandNode( DemandNode * list );
-
-/* End of DemandNode API */
-
-
-/* Start of DemandInGeohash6 API 
- *
- * DemandInGeohash6 is ADT that allows us to store and organize demands by geohash6 value. 
- *
- * The ADT is a hash struture that each entry referring to a list of object DemandInGeohash6
- * that its geohash6 values are hashed into the same hash key. Each DemandInGeohash6 object stores 
- * a list of demands of the same geohash6 and link to next DemandInGeohash6 that has different 
- * geohash6 value but hashed into the same key in the high level DemandInGeohash6 hash structure.
- */
-
-long
-getHashValueOfString( char * s );
-
-DemandInGeohash6 * *
-newDemandInGeohash6( void );
-
-void
-deleteDemandInGeohash6( DemandInGeohash6 * * digh6 );
-
-DemandInGeohash6 *
-insertGeohash6( DemandInGeohash6 * * digh6, char * geohash6, int createIfNotExist  );
-
-DemandInGeohash6 *
-insertDemandInGeohash6( DemandInGeohash6 * * digh6, Demand * d, int createIfNotExist );
-
-void
-processDemandInGeohash6( DemandInGeohash6 * * digh6, Demand * d, long nrDemand, int createIfNotExist );
-
-void
-printDebugDemandInGeohash6( DemandInGeohash6 * * digh6 );
-
-/* End of DemandInGeohash6 API */ 
-
-
-/* global variables */ 
+/* global variables */
 static char * baseProgramName = NULL;
 
 
 int
 main( int argc, char * argv[] )
 {
-    int      day[DAYS_IN_YEAR] = { 0 };
-    int      hourMinInterval[MININTERVALS_IN_DAY * HOURS_IN_DAY] = { 0 };
-    char   * geohash6 = NULL;
-    int      hourMinFrom;
-    int      hourMinTo;
-    int      dayFrom;
-    int      dayTo;
-    Demand * base  = NULL;
-    Demand * dptr  = NULL;
-    long     nrDemand = 0; 
-    int      i;
-    int      ret;
-    int      opt;
-    char     buf[BUFSIZ];
-    FILE *   file = stdin;
+    DemandQuery          query = { { { 0 }, { 0 }, NULL, 0, 0, { 0 }, NULL, NULL, UINT64_MAX }, NULL, 0, 0, { NULL, 0, 0 }, { 0 } };
+    DemandFilter       * filter = &( query.filter );
+    DemandInGeohash6Table * glist = NULL;
+    DemandIndex        * index;
+    int                  aggregate[NUM_AGGREGATE];
+    int                  nrAggregate = 0;
+    int                  groupBy = 0;
+    int                  nrThread;
+    char               * cachePath = NULL;
+    char               * cubePath = NULL;
+    char               * servePath = NULL;
+    char               * connectPath = NULL;
+    char               * queryLine = NULL;
+    char                 err[MAX_ERROR_LEN];
+    int                  isStats = 0;
+    int                  isStatsJson = 0;
+    int                  isFollow = 0;
+    off_t                followOffset = 0;
+    int                  isFeature = 0;
+    DemandFeatureSpec    featureSpec = { { 0 }, 0, { 0 }, 0, 0 };
+    int                  isForecast = 0;
+    DemandForecastSpec   forecastSpec = { FORECAST_NAIVE, 5, 0 };
+    long                 nrTop = 0;
+    double               sampleRate = 1.0;
+    int                  i;
+    int                  opt;
+    FILE             * * file;
+    int                  nrFile;
+    struct option        longOptions[] = 
+    {
+        { "build-cache", required_argument, NULL, OPTION_BUILD_CACHE },
+        { "build-cube",  required_argument, NULL, OPTION_BUILD_CUBE },
+        { "serve",       required_argument, NULL, OPTION_SERVE },
+        { "connect",     required_argument, NULL, OPTION_CONNECT },
+        { "stats",       optional_argument, NULL, OPTION_STATS },
+        { "follow",      no_argument,       NULL, OPTION_FOLLOW },
+        { "features",    no_argument,       NULL, OPTION_FEATURES },
+        { "lags",        required_argument, NULL, OPTION_LAGS },
+        { "windows",     required_argument, NULL, OPTION_WINDOWS },
+        { "forecast",    optional_argument, NULL, OPTION_FORECAST },
+        { "horizon",     required_argument, NULL, OPTION_HORIZON },
+        { "top",         required_argument, NULL, OPTION_TOP },
+        { "approx",      optional_argument, NULL, OPTION_APPROX },
+        { "help",        no_argument,       NULL, 'h' },
+        { NULL,          0,                 NULL, 0 }
+    };
 
     
     // initialization 
@@ -192,23 +107,34 @@ main( int argc, char * argv[] )
         baseProgramName++;
     }   
     
-    for ( i = 0; i < DAYS_IN_YEAR; i++ )
+    nrThread = sysconf( _SC_NPROCESSORS_ONLN );
+    if ( nrThread < 1 )
     {
-        day[i] = 1;
+        nrThread = 1;
     }
 
-    for ( i = 0; i < MININTERVALS_IN_DAY * HOURS_IN_DAY; i++ )
-    {
-	hourMinInterval[i] = 1;
-    }
+    initDemandFilter( filter );
+
+    // the geohash6 values listed in -g are printed in the order they are given 
+    // in when they share the same bucket, as before
+
+    glist = newDemandInGeohash6();
 
     // end of initialization
 
 
     // program option and argument parsing
    
-    while ( ( opt = getopt( argc, argv, "g:d:t:h" ) ) != -1 )
+    while ( ( opt = getopt_long( argc, argv, "g:b:d:t:ua:k:j:h", longOptions, NULL ) ) != -1 )
     {
+        // the query options are kept as they are given for --connect, before 
+        // they are parsed in place
+
+        if ( NULL != strchr( "gbdtak", opt ) )
+        {
+            queryLine = appendDemandQueryLine( queryLine, opt, optarg );
+        }
+
         switch ( opt )
         {
 	    case 'h':
@@ -218,812 +144,513 @@ main( int argc, char * argv[] )
                 printf( "\n" );
                 printf( "[options]\n" );
                 printf( "    -gqp03tu,qp09fu                    Filter demands matching the geohash6 values qp03tu or qp09fu\n" );
+                printf( "    -gqp09*,qp03tu                     Filter demands matching geohash6 values starting with qp09, or qp03tu\n" );
+                printf( "    -b-5.48,90.6,-5.24,90.99           Filter demands matching geohash6 with center in latitude -5.48 to -5.24\n" );
+                printf( "                                       and longitude 90.6 to 90.99, in addition to -g\n" );
                 printf( "    -d1..3,5..6,9                      Filter demands matching day 1 to 3, 5 to 6 or 9\n" );
                 printf( "    -t1000..1045,1315..1345            Filter demands matching time 10:00 to 10:45 or 13:15 to 13:45\n" );
+                printf( "    -u                                 Print matching demands in input order as they are read, without buffering\n" );
+                printf( "    -acount,sum,mean,min,max,stddev    Print the aggregates of matching demands instead of the demands\n" );
+                printf( "    -ap50,p90,p99,distinct             Print the approximate 50th, 90th and 99th percentiles and number of geohash6\n" );
+                printf( "    -kgeohash,day,hour                 Group the aggregates by geohash6, day and hour (or interval for 15 minutes)\n" );
+                printf( "    --top=20                           Print the 20 groups with the largest first aggregate, in its descending order\n" );
+                printf( "    --approx[=0.1]                     Aggregate demands by the threads and merge them, sampling 0.1 of demands\n" );
+                printf( "                                       and scaling count and sum by it, default is all demands\n" );
+                printf( "    -j4                                Read, sort and print demands with 4 threads, default is the number of processors\n" );
+                printf( "    --build-cache=training.cache       Write matching demands into a binary cache file instead of printing them\n" );
+                printf( "    --build-cube=training.cube         Write prefix sums of matching demands by geohash6, day and time into a cube file\n" );
+                printf( "    --serve=/tmp/trafficdemand.sock    Load matching demands once and answer queries over the unix domain socket\n" );
+                printf( "    --connect=/tmp/trafficdemand.sock  Send -g, -b, -d, -t, -a and -k to the server instead of reading files\n" );
+                printf( "    --stats[=json]                     Print time of each phase, rows read and matched, and memory to standard error\n" );
+                printf( "    --follow                           Keep reading lines appended to the file, and print the new matching demands\n" );
+                printf( "                                       or the aggregates they change\n" );
+                printf( "    --features                         Print demands of each geohash6 in time order with lags and windows before them\n" );
+                printf( "    --lags=1..4,96                     Lags of the features in 15 minutes intervals, default is 1..4\n" );
+                printf( "    --windows=4,96                     Windows of the sum and mean features in 15 minutes intervals, default is 4,96\n" );
+                printf( "    --forecast[=naive|smooth|linear]   Print forecasts of each geohash6 after the last demand, default is naive\n" );
+                printf( "    --horizon=5                        Number of 15 minutes intervals to forecast, default is 5\n" );
                 printf( "\n\n" );
                 printf( "If file is not given, it is reading from standard input\n" );
+                printf( "A file written by --build-cache is read directly without parsing\n" );
+                printf( "A file written by --build-cube answers -acount,sum,mean with or without -kgeohash\n" );
                 printf( "\n" );
 		exit( 0 );
 		break;
 
             case 'g':
-                geohash6 = optarg;
+                if ( parseGeohash6Filter( filter, optarg, glist, err ) < 0 )
+                {
+                    fprintf( stderr, "%s\n", err );
+                    exit( 1 );
+                }
+
                 break;
 
-            case 't':
-	        for ( i = 0; i < MININTERVALS_IN_DAY * HOURS_IN_DAY; i++ )
+            case 'b':
+                if ( parseGeohash6BoxFilter( filter, optarg, err ) < 0 )
                 {
-                    hourMinInterval[i] = 0;
+                    fprintf( stderr, "%s\n", err );
+                    exit( 1 );
                 }
 
-                ret = parseRange( optarg, &hourMinFrom, &hourMinTo );
+                break;
+
+            case 'u':
+                query.isUnordered = 1;
+                break;
+
+            case OPTION_BUILD_CACHE:
+                cachePath = optarg;
+                break;
+
+            case OPTION_BUILD_CUBE:
+                cubePath = optarg;
+                break;
+
+            case OPTION_SERVE:
+                servePath = optarg;
+                break;
 
-                do
+            case OPTION_CONNECT:
+                connectPath = optarg;
+                break;
+
+            case OPTION_FOLLOW:
+                isFollow = 1;
+                break;
+
+            case OPTION_FEATURES:
+                isFeature = 1;
+                break;
+
+            case OPTION_LAGS:
+                isFeature = 1;
+                featureSpec.nrLag = parseFeatureList( optarg, featureSpec.lag );
+                if ( featureSpec.nrLag <= 0 )
                 {
-                    if ( ret < 0 )
-                    {
-                        fprintf( stderr, "Invalid argument to -d%s\n", optarg );
-                        exit( 1 );
-                    }
-                    else if ( ret == 0 )
-                    {
-                        break;
-                    }
-                    else
-                    {
-                        int hourFrom;
-			int hourTo;
-			int minFrom;
-			int minTo;
-                        int minIntervalFrom;
-			int minIntervalTo;
-
-                        if ( hourMinFrom > hourMinTo )
-                        {
-                            fprintf( stderr, "Invalid argument to -t, start range argument must be less than or equal to end range argument, example -t1000..1045\n" );
-                            exit( 1 );
-                        }
-                       
-			hourFrom = hourMinFrom / 100;
-			hourTo = hourMinTo / 100;
-			minFrom = hourMinFrom % 100;
-			minTo = hourMinTo % 100;
-
-                        if ( hourFrom >= 24 
-			     || hourTo >= 24 
-                             || minFrom >= 60
-                             || minTo >= 60 )
-			{
-			    fprintf( stderr, "Invalid argument to -t, 1015 means hour 10 and min 15\n" );
-			    exit( 1 );
-			}
-
-                        minIntervalFrom = minFrom / MIN_IN_MININTERVAL;
-			minIntervalTo = minTo / MIN_IN_MININTERVAL;
-
-	                for ( i = hourFrom * MININTERVALS_IN_DAY + minIntervalFrom; i <= hourFrom * MININTERVALS_IN_DAY + minIntervalTo; i++ )
-			{
-			    hourMinInterval[i] = 1;   
-			}
-
-                        ret = parseRange( NULL, &hourMinFrom, &hourMinTo );
-                    }
+                    fprintf( stderr, "Invalid argument to --lags=%s, up to %d of 1 to %d, example --lags=1..4,96\n", optarg, MAX_NUM_FEATURE, MININTERVALS_IN_YEAR - 1 );
+                    exit( 1 );
                 }
-                while ( 1 );
 
-		break;
+                break;
 
-            case 'd':
-                for ( i = 0; i < DAYS_IN_YEAR; i++ )
+            case OPTION_TOP:
+                nrTop = atol( optarg );
+                if ( nrTop <= 0 )
                 {
-                    day[i] = 0;
+                    fprintf( stderr, "argument to --top must be more than 0\n" );
+                    exit( 1 );
                 }
 
-                ret = parseRange( optarg, &dayFrom, &dayTo );
+                break;
 
-		do	
-		{
-                    if ( ret < 0 )
+            case OPTION_APPROX:
+                query.isApproximate = 1;
+                if ( NULL != optarg )
+                {
+                    sampleRate = atof( optarg );
+                    if ( sampleRate <= 0.0
+                         || sampleRate > 1.0 )
                     {
-                        fprintf( stderr, "Invalid argument to -d%s\n", optarg );
+                        fprintf( stderr, "argument to --approx must be more than 0 and up to 1\n" );
                         exit( 1 );
                     }
-                    else if ( ret == 0 )
+                }
+
+                break;
+
+            case OPTION_FORECAST:
+                isForecast = 1;
+                if ( NULL != optarg )
+                {
+                    forecastSpec.model = parseForecastModel( optarg );
+                    if ( forecastSpec.model < 0 )
                     {
-                        break;
+                        fprintf( stderr, "Invalid argument to --forecast=%s, it is naive, smooth or linear\n", optarg );
+                        exit( 1 );
                     }
-                    else
-		    {
-                        if ( dayFrom <= 0  
-                             || dayTo <= 0 )
-                        {
-                            fprintf( stderr, "argument to -d must be 1 and less than 366\n" );
-                            exit( 1 );
-                        }
- 
-                        if ( dayFrom > dayTo )
-                        {
-                            fprintf( stderr, "start range argument must be less than or equal to end range argument, example -d1..3\n" );
-                            exit( 1 );
-                        }
-
-                        for ( i = dayFrom - 1; i < dayTo; i++ )
-                        {
-                            day[i] = 1;
-                        }
-
-                        ret = parseRange( NULL, &dayFrom, &dayTo ); 
- 		    }
-		}
-		while ( 1 );
-          
-		break;
+                }
 
-            default:
-                fprintf( stderr, "invalid option (%c) and argument\n", opt );
-                exit( 1 );
-        }
-    }
+                break;
 
-    argc -= optind;
-    argv += optind;   
+            case OPTION_HORIZON:
+                isForecast = 1;
+                forecastSpec.horizon = atoi( optarg );
+                if ( forecastSpec.horizon < 1
+                     || forecastSpec.horizon > MAX_NUM_HORIZON )
+                {
+                    fprintf( stderr, "argument to --horizon must be 1 to %d\n", MAX_NUM_HORIZON );
+                    exit( 1 );
+                }
 
-    if ( argc-- > 0 )
-    {
-        file = fopen( *argv++, "r" );
-        if ( file == NULL) 
-        {
-            fprintf( stderr, "open file error: %s\n", *argv );
-            exit( 1 );
-        }
-    }
+                break;
 
-    // end of program option and argument parsing
+            case OPTION_WINDOWS:
+                isFeature = 1;
+                featureSpec.nrWindow = parseFeatureList( optarg, featureSpec.window );
+                if ( featureSpec.nrWindow <= 0 )
+                {
+                    fprintf( stderr, "Invalid argument to --windows=%s, up to %d of 1 to %d, example --windows=4,96\n", optarg, MAX_NUM_FEATURE, MININTERVALS_IN_YEAR - 1 );
+                    exit( 1 );
+                }
 
-    // read data from standard input or files
+                break;
 
-    do
-    {
-        while ( fgets( buf, sizeof buf, file ) != NULL )
-        {
-            if ( NULL == base )
-            {
-               base = malloc( NUM_DEMAND_PER_NODE  * ( sizeof ( base[0] ) ) );
-               dptr = base;
-            }
-            else if ( ( nrDemand % NUM_DEMAND_PER_NODE ) == 0 )
-            {
-                dptr = realloc( base, ( nrDemand + NUM_DEMAND_PER_NODE ) * sizeof ( base[0] )  );
-                if ( dptr  == NULL )
+            case OPTION_STATS:
+                isStats = 1;
+                if ( NULL != optarg )
                 {
-                    free( base );
+                    if ( strcmp( optarg, "json" ) == 0 )
+                    {
+                        isStatsJson = 1;
+                    }
+                    else if ( strcmp( optarg, "text" ) != 0 )
+                    {
+                        fprintf( stderr, "Invalid argument to --stats=%s, it is text or json\n", optarg );
+                        exit( 1 );
+                    }
                 }
 
-                base = dptr;              
-            }
-
-            if ( dptr == NULL )
-            {
-                fprintf( stderr, "no memory\n" );
-                exit( 1 );
-            }
+                break;
 
-	    if ( scanDemand( buf, &( dptr[nrDemand] ) ) )
-            {
-                nrDemand++;
-            }
-        } // while still got next line
-       
-        if ( argc-- > 0 )
-        {
-           file = fopen( *argv++, "r" );
-           if ( file == NULL) 
-           {
-               fprintf( stderr, "open file error: %s\n", *argv );
-               exit( 1 );
-           }
-        }
-        else
-        {
-           break;  
-        }
-    } while ( 1 );
+            case 'j':
+                nrThread = atoi( optarg );
+                if ( nrThread < 1 
+                     || nrThread > MAX_NUM_THREAD )
+                {
+                    fprintf( stderr, "argument to -j must be 1 to %d\n", MAX_NUM_THREAD );
+                    exit( 1 );
+                }
 
-    // end of read data from standard input or files
+                break;
 
-    // processing data into output
-    {
-        DemandInGeohash6 * * glist = NULL;
-        int                  hasFilterGeohash6 = 0;
+            case 'a':
+                nrAggregate = parseAggregate( optarg, aggregate );
+                if ( nrAggregate <= 0 )
+                {
+                    fprintf( stderr, "Invalid argument to -a%s, example -acount,sum,mean,min,max,stddev\n", optarg );
+                    exit( 1 );
+                }
 
+                break;
 
-        hasFilterGeohash6 = ( NULL != geohash6 );
+            case 'k':
+                groupBy = parseGroupBy( optarg );
+                if ( groupBy < 0 )
+                {
+                    fprintf( stderr, "Invalid argument to -k%s, example -kgeohash,day,hour or -kinterval\n", optarg );
+                    exit( 1 );
+                }
 
-        glist = newDemandInGeohash6();
-        
-        if ( hasFilterGeohash6 )
-        {
-            char *tok = NULL;
+                break;
 
-            tok = strtok( geohash6, "," );
-            while ( NULL != tok )
-            {
-                insertGeohash6( glist, tok, 1 );
-   
-                tok = strtok( NULL, "," );
-            }
-        }
+            case 't':
+                if ( parseTimeFilter( filter, optarg, err ) < 0 )
+                {
+                    fprintf( stderr, "%s\n", err );
+                    exit( 1 );
+                }
 
-        for ( i = 0; i < nrDemand; i++ )
-        {
-            if ( day[dptr[i].day - 1] 
-                 && hourMinInterval[dptr[i].hh * MININTERVALS_IN_DAY + ( dptr[i].mm / MIN_IN_MININTERVAL ) ] )
-            {
-                insertDemandInGeohash6( glist, &( dptr[i] ), ! hasFilterGeohash6 );
-            }
-        }
+		break;
 
-        printDebugDemandInGeohash6( glist );
+            case 'd':
+                if ( parseDayFilter( filter, optarg, err ) < 0 )
+                {
+                    fprintf( stderr, "%s\n", err );
+                    exit( 1 );
+                }
+          
+		break;
 
-        deleteDemandInGeohash6( glist );
+            default:
+                fprintf( stderr, "invalid option (%c) and argument\n", opt );
+                exit( 1 );
+        }
     }
 
-    // processing data into output
-
-    return 0;
-}
-
-
-/* Start of DemandNode API */
-
-DemandNode *
-newDemandNode( void )
-{
-    DemandNode * newNode;
-
+    argc -= optind;
+    argv += optind;   
 
-    /* reduce by 1 because DemandNode already contains 1 element for the array
-     */
-    newNode = malloc( sizeof( DemandNode ) + ( ( NUM_DEMAND_PER_NODE - 1 ) * ( sizeof( Demand * ) ) ) );
-    if ( NULL == newNode )
+    if ( groupBy != 0
+         && nrAggregate == 0 )
     {
-        fprintf( stderr, "failed to allocate memory for more DemandNode\n" );
+        fprintf( stderr, "-k is only used with -a\n" );
         exit( 1 );
     }
 
-    newNode->next = NULL;
-    newNode->prev = NULL;
-    newNode->cnt = 0;
-
-    return newNode;
-}
-
-
-void
-deleteDemandNode( DemandNode * item )
-{
-    DemandNode * tmp;
-
+    if ( NULL != connectPath )
+    {
+        if ( argc > 0
+             || query.isUnordered
+             || query.isApproximate
+             || nrTop > 0
+             || isFeature
+             || isForecast
+             || isFollow
+             || isStats
+             || NULL != cachePath 
+             || NULL != cubePath 
+             || NULL != servePath )
+        {
+            fprintf( stderr, "--connect only sends -g, -b, -d, -t, -a and -k to the server\n" );
+            exit( 1 );
+        }
 
-    while ( NULL != item )
-    {
-        tmp = item;
-        item = item->next;
- 
-        free( tmp );
+        return queryDemandServer( connectPath, NULL == queryLine ? "" : queryLine );
     }
 
-    free( item );
-}
-
-
-DemandNode *
-processDemandNode( DemandNode * list, Demand * dptr, long nrDemand )
-{
-    long         i;   
-    DemandNode * newNode;
-
-
-    for ( i = 0; i < nrDemand; i++ )
+    if ( nrAggregate > 0 )
     {
-        if ( NULL == list
-             || list->cnt >= NUM_DEMAND_PER_NODE )
+        if ( query.isUnordered )
         {
-            newNode = newDemandNode();
-
-            newNode->next = list;
-            if ( NULL != list )
-            {
-	        list->prev = newNode;
-            }
-
-            list = newNode;
-        }  
+            fprintf( stderr, "-u can not be used with -a\n" );
+            exit( 1 );
+        }
 
-        list->d[list->cnt++] = &( dptr[i] );
+        query.agg = newDemandAggregate( groupBy, aggregate, nrAggregate );
     }
 
-    return list;
-}
-
-
-void
-printDebugDemandNode( DemandNode * item )
-{
-    int i;
-
-
-    while ( NULL != item )
+    if ( query.isApproximate )
     {
-        for ( i = 0; i < item->cnt; i++ )
+        if ( NULL == query.agg )
         {
-            printf( "%s,%02d,%02d:%02d,%.18lf\n", 
-                    item->d[i]->geohash6, 
-                    item->d[i]->day,
-                    item->d[i]->hh, 
-                    item->d[i]->mm, 
-                    item->d[i]->value );
+            fprintf( stderr, "--approx needs -a\n" );
+            exit( 1 );
         }
 
-        item = item->next;
+        setSampleRateOfDemandQuery( &query, sampleRate );
     }
-}
-
-/* End of DemandNode API */
 
-
-/* Start of DemandInGeohash6 API */
-
-long
-getHashValueOfString( char * s )
-{
-    long result;
-    int  c;
-
-
-    result = 0;
-    while ( ( c = *s++ )  != '\0' )
+    if ( ( NULL != cachePath 
+           || NULL != cubePath
+           || NULL != servePath )
+         && ( NULL != query.agg 
+              || query.isUnordered ) )
     {
-        result = result * HASH_MULTIPLIER + c;   
+        fprintf( stderr, "--build-cache, --build-cube and --serve can not be used with -a or -u\n" );
+        exit( 1 );
     }
 
-    return result % NUM_HASH_SIZE;
-}
-
-
-DemandInGeohash6 * *
-newDemandInGeohash6( void )
-{
-    DemandInGeohash6 * * digh6 = NULL;
-    int                  i;
-
-
-    digh6 = malloc( NUM_HASH_SIZE * sizeof( DemandInGeohash6 * ) );
-    if ( NULL == digh6 )
+    if ( nrTop > 0
+         && ( NULL == query.agg 
+              || isFollow ) )
     {
-        fprintf( stderr, "failed to allocte memory for more DemandInGeohash6 *\n" );
+        fprintf( stderr, "--top needs -a, and can not be used with --follow\n" );
         exit( 1 );
     }
 
-    for ( i = 0; i < NUM_HASH_SIZE; i++ )
+    if ( isFeature
+         || isForecast )
     {
-        digh6[i] = NULL;
-    } 
-
-    return digh6;
-}
-
-
-void
-deleteDemandInGeohash6( DemandInGeohash6 * * digh6 )
-{
-    int                i;
-    DemandInGeohash6 * hashItem;  
-    DemandInGeohash6 * next;
-
-
-    for ( i = 0; i < NUM_HASH_SIZE; i++ )
-    {
-        for ( hashItem = digh6[i]; NULL != hashItem; hashItem = next )
+        if ( ( isFeature && isForecast )
+             || NULL != query.agg
+             || query.isUnordered
+             || NULL != cachePath 
+             || NULL != cubePath
+             || NULL != servePath
+             || isFollow )
         {
-            next = hashItem->next;
-            
-            deleteDemandNode( hashItem->d );
-            free( hashItem );   
+            fprintf( stderr, "--features and --forecast can not be used together or with -a, -u, --build-cache, --build-cube, --serve, --connect or --follow\n" );
+            exit( 1 );
         }
-    }
-
-    free( digh6 );
-}
 
+        if ( 0 == featureSpec.nrLag 
+             && 0 == featureSpec.nrWindow )
+        {
+            featureSpec.nrLag = 4;
+            featureSpec.lag[0] = 1;
+            featureSpec.lag[1] = 2;
+            featureSpec.lag[2] = 3;
+            featureSpec.lag[3] = 4;
+            featureSpec.nrWindow = 2;
+            featureSpec.window[0] = MININTERVALS_IN_DAY;
+            featureSpec.window[1] = MININTERVALS_IN_DAY * HOURS_IN_DAY;
+        }
 
-DemandInGeohash6 *
-insertGeohash6( DemandInGeohash6 * * digh6, char * geohash6, int createIfNotExist  )
-{
-    long               hashkey;
-    DemandInGeohash6 * hashItem = NULL;
- 
-
-    hashkey = getHashValueOfString( geohash6 ); 
-
-    assert( hashkey >= 0 && hashkey < NUM_HASH_SIZE );
+        for ( i = 0; i < featureSpec.nrLag; i++ )
+        {
+            featureSpec.span = ( featureSpec.lag[i] > featureSpec.span ) ? featureSpec.lag[i] : featureSpec.span;
+        }
 
-    for ( hashItem = digh6[hashkey]; hashItem != NULL; hashItem = hashItem->next )
-    {   
-        if ( strcmp( hashItem->geohash6, geohash6 ) == 0 )
-        {   
-            break;
+        for ( i = 0; i < featureSpec.nrWindow; i++ )
+        {
+            featureSpec.span = ( featureSpec.window[i] > featureSpec.span ) ? featureSpec.window[i] : featureSpec.span;
         }
     }
-    
-    if ( NULL == hashItem 
-         && createIfNotExist )
+
+    if ( isFollow
+         && ( 1 != argc
+              || NULL != cachePath 
+              || NULL != cubePath
+              || NULL != servePath ) )
     {
-        hashItem = malloc( sizeof( * hashItem ) );
-        if ( NULL == hashItem )
-        {   
-            fprintf( stderr, "failed to allocate memory for more DemandInGeohash6\n" );
-            exit( 1 );
-        }
-        
-        strncpy( hashItem->geohash6, geohash6, sizeof( hashItem->geohash6 ) );
-        hashItem->d = NULL;
-        hashItem->next = digh6[hashkey];
-        digh6[hashkey] = hashItem;
+        fprintf( stderr, "--follow reads one file, and can not be used with --build-cache, --build-cube or --serve\n" );
+        exit( 1 );
     }
 
-    return hashItem;
-}
-
-
-DemandInGeohash6 *
-insertDemandInGeohash6( DemandInGeohash6 * * digh6, Demand * d, int createIfNotExist )
-{
-    DemandInGeohash6 * hashItem;
-
-    
-    hashItem = insertGeohash6( digh6, d->geohash6, createIfNotExist );
+    compileDemandFilter( filter );
 
-    if ( NULL != hashItem )
-    {
-        hashItem->d = processDemandNode( hashItem->d, d, 1 );
-    }
+    // end of program option and argument parsing
 
-    return hashItem;
-}
+    // read data from standard input or files, the filters are applied as soon as 
+    // a line is scanned, so only matching demands are kept in memory (or none of 
+    // them when they are printed in input order)
 
+    startDemandPhase( &( query.stats ), "read" );
 
-void
-processDemandInGeohash6( DemandInGeohash6 * * digh6, Demand * d, long nrDemand, int createIfNotExist )
-{
-    while ( nrDemand-- > 0 )
+    nrFile = ( argc > 0 ) ? argc : 1;
+    file = malloc( nrFile * sizeof( file[0] ) );
+    if ( NULL == file )
     {
-        insertDemandInGeohash6( digh6, d++, createIfNotExist );
+        fprintf( stderr, "failed to allocate memory for files\n" );
+        exit( 1 );
     }
-}
-
-
-void
-printDebugDemandInGeohash6( DemandInGeohash6 * * digh6 )
-{
-    int                i;
-    DemandInGeohash6 * hashItem;
 
+    file[0] = stdin;
 
-    for ( i = 0; i < NUM_HASH_SIZE; i++ )
+    for ( i = 0; i < argc; i++ )
     {
-        for ( hashItem = digh6[i]; NULL != hashItem; hashItem = hashItem->next )
+        file[i] = fopen( argv[i], "r" );
+        if ( file[i] == NULL) 
         {
-            DemandInTime * dit;
-            DemandNode   * list;
-
-            dit = newDemandInTime();
-            
-            for ( list = hashItem->d; NULL != list; list = list->next )
-            {
-                processDemandNodeInTime( dit, list );
-            }
-
-            printDebugDemandInTime( dit );
-
-	    deleteDemandInTime( dit );
+            fprintf( stderr, "open file error: %s\n", argv[i] );
+            exit( 1 );
         }
     }
-}
-
-/* End of DemandInGeohash6 API */
-
-
-/* Start of DemandInTime API */
-
-DemandInTime *
-newDemandInTime( void )
-{
-    DemandInTime * dit;
-    int            i;
-
-
-    dit = malloc( sizeof( *dit ) );
-    if ( NULL == dit )
-    {
-        fprintf( stderr, "failed to allocate more memory for DemandInTime\n" );
-        exit( 1 );
-    }
-
-    for ( i = 0; i < DAYS_IN_YEAR; i++ )
-    {   
-        dit->day[i] = NULL;
-    } 
-
-    for ( i = 0; i < HOURS_IN_YEAR; i++ )
-    {
-        dit->hour[i] = NULL;
-    } 
-
-    for ( i = 0; i < MININTERVALS_IN_YEAR; i++ )
-    {
-        dit->mininterval[i] = NULL;
-    } 
-
-    return dit;
-}
-
-
-void
-deleteDemandInTime( DemandInTime * dit )
-{
-    int i;
 
+    // a followed file is kept open to read what is appended to it
 
-    for ( i = 0; i < DAYS_IN_YEAR; i++ )
+    if ( isFollow )
     {
-        deleteDemandNode( dit->day[i] );  
+        readDemandFromFollowedFile( &query, fileno( file[0] ), &followOffset );
     }
- 
-    for ( i = 0; i < HOURS_IN_YEAR; i++ )
-    {
-        deleteDemandNode( dit->hour[i] );  
-    }
- 
-    for ( i = 0; i < MININTERVALS_IN_YEAR; i++ )
+    else
     {
-        deleteDemandNode( dit->mininterval[i] );  
-    }
- 
-    free( dit );   
-}
-
-
-void
-printDebugDemandInTime( DemandInTime * dit )
-{
-    int dayIndex;
-    int hourIndex;
-    int minIntervalIndex;
-
+        if ( readDemand( &query, file, nrFile, nrThread, err ) < 0 )
+        {
+            fprintf( stderr, "%s\n", err );
+            exit( 1 );
+        }
 
-    for ( dayIndex = 0; dayIndex < DAYS_IN_YEAR; dayIndex++ )
-    {
-        if ( NULL != dit->day[dayIndex] )
-        { 
-            for ( hourIndex = dayIndex * HOURS_IN_DAY; hourIndex < dayIndex * HOURS_IN_DAY + HOURS_IN_DAY; hourIndex++ )
+        for ( i = 0; i < nrFile; i++ )
+        {
+            if ( stdin != file[i] )
             {
-                if ( NULL != dit->hour[hourIndex] )
-                {
-                    for ( minIntervalIndex = hourIndex * MININTERVALS_IN_DAY; minIntervalIndex < hourIndex * MININTERVALS_IN_DAY + MININTERVALS_IN_DAY; minIntervalIndex++ )
-                    {
-                         if ( NULL != dit->mininterval[minIntervalIndex] )
-                         {
-                             printDebugDemandNode( dit->mininterval[minIntervalIndex] );
-                         }
-                    }          
-                }
+                fclose( file[i] );
             }
         }
     }
-}
 
+    endDemandPhase( &( query.stats ) );
 
-void
-processDemandInTime( DemandInTime * dit, Demand * dptr, long nrDemand )
-{
-    long i;
-    int  dayIndex;
-    int  hourIndex;
-    int  minIntervalIndex;
+    // end of read data from standard input or files
 
+    // processing data into output
 
-    for ( i = 0; i < nrDemand; i++ )
+    if ( NULL != cachePath
+         || NULL != cubePath )
     {
-        // day is started at 1, hour at 0 and min interval at 0 from import data
-
-        dayIndex  = dptr[i].day - 1;  
-        hourIndex = dayIndex * HOURS_IN_DAY + dptr[i].hh;
-        minIntervalIndex = hourIndex * MININTERVALS_IN_DAY + ( dptr[i].mm / MIN_IN_MININTERVAL );
-
-        assert( dayIndex < DAYS_IN_YEAR );
-        assert( hourIndex < HOURS_IN_YEAR );
-        assert( minIntervalIndex < MININTERVALS_IN_YEAR );
+        if ( NULL != cachePath )
+        {
+            startDemandPhase( &( query.stats ), "cache" );
+            writeDemandCache( cachePath, &( query.result ) );
+            endDemandPhase( &( query.stats ) );
+        }
 
-        dit->day[dayIndex] = processDemandNode( dit->day[dayIndex], &( dptr[i] ), 1 );
-        dit->hour[hourIndex] = processDemandNode( dit->hour[hourIndex], &( dptr[i] ), 1 );
-        dit->mininterval[minIntervalIndex] = processDemandNode( dit->mininterval[minIntervalIndex], &( dptr[i] ), 1 );
+        if ( NULL != cubePath )
+        {
+            startDemandPhase( &( query.stats ), "cube" );
+            writeDemandCube( cubePath, &( query.result ) );
+            endDemandPhase( &( query.stats ) );
+        }
     }
-}
-
-
-void
-processDemandNodeInTime( DemandInTime * dit, DemandNode * list )
-{
-    int i;
-
-
-    for ( i = 0; i < list->cnt; i++ )
+    else if ( NULL != query.agg )
     {
-        processDemandInTime( dit, list->d[i], 1 );
-    }
-}
-
-/* End of DemandInTime API */
-
-
-Demand *
-scanDemand( char * cptr, Demand * dptr )
-{
-    int    c;
-    int    inMm        = 0;
-    int    index       = 0;
-    int    geohash6Len = 0;
-    Demand d           = { "\0", 0, 0, 0.0 };
+        startDemandPhase( &( query.stats ), "output" );
 
-
-    while ( ( c = *cptr++ ) != '\0'
-            && c != '\n' )
-    {
-        if ( ',' == c )
+        if ( nrTop > 0 )
         {
-            if ( 0 == index )
-            {
-                d.geohash6[geohash6Len] = '\0';
-            }
-            else if ( 2 == index )
-            {
-                d.value = atof( cptr );
-                break;
-            }
-
-            index++;
+            printTopOfDemandAggregate( stdout, query.agg, nrTop );
         }
         else
         {
-            switch ( index )
-            {
-                case 0:
-                    if ( geohash6Len < 6 )
-                    {
-                        d.geohash6[geohash6Len++] = c;
-                    }
-                    else
-                    {
-                        return NULL;
-                    }
+            printDemandAggregate( stdout, query.agg );
+        }
 
-                    break;
+        endDemandPhase( &( query.stats ) );
 
-                case 1:
-                    if ( !isdigit( c ) )
-                    {
-                        return NULL;                      
-                    }
+        statDemandAggregate( &( query.stats ), query.agg );
+    }
+    else if ( ! query.isUnordered )
+    {
+        startDemandPhase( &( query.stats ), "index" );
+        index = newDemandIndex( &( query.result ), nrThread );
+        endDemandPhase( &( query.stats ) );
 
-                    d.day = d.day * 10 + ( c - '0' );
-                    break;
+        statDemandIndex( &( query.stats ), index );
 
-                case 2:
-                    if ( c == ':' )
-                    {
-                        inMm = 1;
-                    }
-                    else 
-                    {
-                        if ( !isdigit( c ) )
-                        {
-                            return NULL;                      
-                        }
-
-                        if ( inMm )
-                        {
-                            d.mm = d.mm * 10 + ( c - '0' );
-                        }
-                        else
-                        {
-                            d.hh = d.hh * 10 + ( c - '0' );
-                        }
-                    }
-
-                    break;
-            } // switch        
-        } // else not yet reach ','
-    } // while not end of line
+        if ( NULL != servePath )
+        {
+            // the server does not return, the stats are of loading the demands
 
-    *dptr = d;
+            if ( isStats )
+            {
+                query.stats.bufferSize = query.result.maxDemand * sizeof( Demand );
+                printDemandStats( stderr, &( query.stats ), isStatsJson );
+            }
 
-    return dptr;
-}
+            serveDemandIndex( servePath, index );
+        }
 
+        startDemandPhase( &( query.stats ), "output" );
 
-/* the function parses the following pattern of string into both from and to values 
- * in each call. Passing NULL as s when you want to continue parsing where the last 
- * parse stops.
- *
- * 1,3,5
- * - 1st parse (not NULL) will reeturn 1 and 1
- * - 2nd parse (NULL) will return 3 and 3
- * - 3rd parse (NULL) will return 5 and 5
- *
- * 1..3,5,7..9
- * - 1st parse (not NULL) will return 1 and 3 
- * - 2nd parse (NULL) will return 5 and 5
- * - 3rd parse (NULL) will return 7 and 9
- *
- * it returns 1 when parsing is success, 0 when EOF (no data for further parsing)
- * -1 when it fails to parse the string because of none-numeric character or because
- * instead of 1..5, we put 1.,5
- */
-int
-parseRange( char * s, int * from, int * to )
-{
-    int           val;
-    int           c;
-    static char * ls  = NULL;
+        if ( isFeature )
+        {
+            printDemandFeatureHeader( stdout, &featureSpec );
+            runDemandTask( stdout, index, printDemandFeatureOfGeohash6, &featureSpec, nrThread );
+        }
+        else if ( isForecast )
+        {
+            forecastSpec.last = getLastMinIntervalOfDemandIndex( index );
+            runDemandTask( stdout, index, printDemandForecastOfGeohash6, &forecastSpec, nrThread );
+        }
+        else
+        {
+            printDemandIndex( stdout, index, filter, glist, nrThread );
+        }
 
+        fflush( stdout );
+        endDemandPhase( &( query.stats ) );
 
-    if ( NULL != s )
-    {
-        ls = s;
+        deleteDemandIndex( index );
     }
-   
-    assert( NULL != ls );
 
-    if ( '\0' == *ls )
+    if ( isStats )
     {
-        return 0;
-    }
- 
-    val = 0;
-    while ( ( c = *ls ) != '\0'
-            && isdigit( c ) )
-    {
-        val = val * 10 + ( c - '0' );
-        ls++;
+        query.stats.bufferSize = query.result.maxDemand * sizeof( Demand );
+        printDemandStats( stderr, &( query.stats ), isStatsJson );
     }
 
-    if ( '\0' != c
-         && '.' != c 
-         && ',' != c )
+    if ( isFollow )
     {
-        return -1;
-    }
+        fflush( stdout );
 
-    *from = val;
-    *to = val;
+        followDemand( &query, fileno( file[0] ), followOffset );
+    }
 
-    if ( ',' == c )
+    if ( NULL != query.agg )
     {
-        ls++;
+        deleteDemandAggregate( query.agg );
     }
-    else if ( '.' == c )
-    {
-        ls++;
 
-        if ( ( c = *( ls++ ) ) != '.' )
-        {
-            return -1;
-        }
+    deleteDemandInGeohash6( glist );
+    free( filter->geohash6 );
+    free( filter->isPrefixAny );
+    free( query.result.d );
+    free( queryLine );
+    free( file );
 
-        val = 0;
-        while ( ( c = *ls ) != '\0'
-                && isdigit( c ) )
-        {
-            val = val * 10 + ( c - '0' );
-            ls++;
-        }
-
-        if ( '\0' != c
-             && '.' != c
-             && ',' != c )
-        {
-            return -1;
-        }
-  
-        *to = val;
-
-        if ( ',' == c )
-        {
-            ls++;
-        }
-    }
+    // processing data into output
 
-    return 1;
+    return 0;
 }
-
@@ -0,0 +1,154 @@
+/*
+ * Copyright 2019, Chee Bin Hoh, All right reserved.
+ *
+ * This is the public interface of the traffic demand library, libtrafficdemand.c, for a 
+ * program that embeds it. The demands of files are loaded into a DemandDataset and queried 
+ * by a line of options, and the result is given to callbacks as Demand and DemandInGroup. 
+ * The rest of the library, that trafficdemand.c the command-line interface is built on, is 
+ * in libtrafficdemand.h and is not part of this interface.
+ *
+ */
+
+
+#ifndef TRAFFICDEMAND_H
+#define TRAFFICDEMAND_H
+
+
+#include <stdio.h>
+#include <stdint.h>
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+enum
+{
+    MAX_ERROR_LEN = 256
+};
+
+
+enum
+{
+    AGGREGATE_COUNT,
+    AGGREGATE_SUM,
+    AGGREGATE_MEAN,
+    AGGREGATE_MIN,
+    AGGREGATE_MAX,
+    AGGREGATE_STDDEV,
+    AGGREGATE_P50,
+    AGGREGATE_P90,
+    AGGREGATE_P99,
+    AGGREGATE_DISTINCT,
+    NUM_AGGREGATE
+};
+
+
+enum
+{
+    GROUP_BY_GEOHASH6    = 1,
+    GROUP_BY_DAY         = 2,
+    GROUP_BY_HOUR        = 4,
+    GROUP_BY_MININTERVAL = 8
+};
+
+
+typedef struct demand Demand;
+
+struct demand
+{
+    uint32_t geohash6; // base32 geohash6 value encoded in 30 bits
+    int    day;
+    int    hh;
+    int    mm;
+    double value;
+};
+
+
+typedef struct demandsketch DemandSketch;
+
+
+typedef struct demandingroup DemandInGroup;
+
+struct demandingroup
+{
+    DemandInGroup * next;
+    Demand          key;     // only the fields that demands are grouped by are set
+    long            cnt;
+    double          sum;
+    double          min;
+    double          max;
+    double          mean;    // running mean and sum of squared differences from it,
+    double          m2;      // both are updated by Welford's method for stddev
+    DemandSketch  * sketch;  // NULL when there is no quantile or distinct aggregate
+};
+
+
+typedef struct demandaggregate DemandAggregate;
+
+struct demandaggregate
+{
+    int               groupBy;
+    int               aggregate[NUM_AGGREGATE];
+    int               nrAggregate;
+    int               isQuantile;  // a quantile or distinct aggregate is kept by the sketch
+    int               isDistinct;  // of each group
+    double            scale;       // count and sum are divided by the sample rate
+    long              nrGroup;
+    long              nrBucket;
+    DemandInGroup * * bucket;
+};
+
+
+/* the functions called back for each matching demand and each group of the aggregates of 
+ * a query, arg is passed as it is given.
+ */
+typedef void ( * DemandFunction )( Demand * d, void * arg );
+
+typedef void ( * DemandInGroupFunction )( DemandAggregate * agg, DemandInGroup * group, void * arg );
+
+
+void
+printDemand( FILE * out, Demand * d );
+
+void
+printDemandInGroup( FILE * out, DemandAggregate * agg, DemandInGroup * group );
+
+double
+getValueOfDemandInGroup( DemandAggregate * agg, DemandInGroup * group, int aggregate );
+
+
+/* Start of DemandDataset API
+ *
+ * DemandDataset is the dataset of a program that embeds the library, the demands of files 
+ * are read once into a DemandIndex and queried any number of times in the same process. A 
+ * query is the same line of options as a query sent to the server, and its result is given 
+ * to callbacks instead of being printed, the demands as Demand and the aggregates as 
+ * DemandInGroup, whose values are taken by getValueOfDemandInGroup. Queries do not change 
+ * the dataset and no function keeps state between calls, so a dataset is queried by any 
+ * number of threads at the same time. An invalid query, a file that can not be opened, 
+ * a cache or cube that can not be read or answer the query, or a gzip or zstd file that 
+ * ends at an error returns the error message, while running out of memory or failing to 
+ * create a thread exits like the command line.
+ */
+
+typedef struct demanddataset DemandDataset;
+
+DemandDataset *
+loadDemandDataset( char * * path, int nrPath, char * line, int nrThread, char * err );
+
+void
+deleteDemandDataset( DemandDataset * dataset );
+
+int
+queryDemandDataset( DemandDataset * dataset, char * line, DemandFunction onDemand, DemandInGroupFunction onGroup, void * arg, char * err );
+
+/* End of DemandDataset API */
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif